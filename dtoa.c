@@ -10,22 +10,170 @@
  * 24Feb03  R Weber     Updated to increase speed.
  * 08Mar04  R Weber     Updated for Atmega169
  * 06Oct05	T Lill		Removed deprecated functions
+ * 16Oct26	agent		Added bursts to several D/As, pre-encoded frames, PWM
+ *						output, write statistics, and calibration kept in EEPROM.
  ******************************************************************************/
+#include <util/atomic.h>
+#if defined (D2A_CALIBRATION)
+#include <avr/eeprom.h>
+#endif
+
 #include "lib.h"
 #include "errors.h"
 #include "dtoa.h"
 #include "serial.h"
 
-// Number of bytes to send on each SPI transmission
-#define SPI_NUM_BYTES               2
+static volatile D2AStatsType D2AStats;
+
+#if defined (D2A_CALIBRATION)
+/* Calibration of each D/A, as kept in EEPROM. The check byte tells a
+ * record that's been written from erased or stale EEPROM. */
+#define D2A_CAL_CHECK_SEED			0xA5
+
+typedef struct
+{
+	D2ACalType Cal;
+	unsigned char ucCheck;
+} D2ACalRecordType;
+
+static D2ACalRecordType EEMEM CalRecords[D2A_CHANNELS];
+
+/* Records waiting to be written to EEPROM by ServiceDtoACal, and how many of
+ * their bytes are left to write. */
+static D2ACalRecordType CalPending[D2A_CHANNELS];
+static unsigned char CalBytesLeft[D2A_CHANNELS];
+
+static unsigned char CalCheck(const D2ACalType *);
+#endif
+
+#if defined (D2A_PWM)
+/* Compare register of each PWM output */
+static volatile uint16_t * const PwmCompares[D2A_CHANNELS] = {
+	&OCR4A,
+#if (D2A_CHANNELS > 1)
+	&OCR4B,
+#endif
+#if (D2A_CHANNELS > 2)
+	&OCR4C,
+#endif
+};
+
+/******************************************************************************
+ * This function initializes the PWM outputs that stand in for the D/A.
+ ******************************************************************************/
+void InitDtoA(void)
+{
+	/* Timer 4 in fast PWM mode 14, counting from 0 to ICR4 at F_CPU, so the
+	 * period is 2^D2A_BITS clocks. Each output is set at the start of the
+	 * period and cleared on its compare match:
+	 *   COM4x1:	1 - Non-inverting PWM on each output in use
+	 *   WGM43:0:	1110 - Fast PWM, TOP = ICR4
+	 *   CS42:0:	001 - No prescaling
+	 * The compare registers are double buffered, and only take a new value
+	 * at the start of a period, so each period is a whole sample.
+	 */
+	TCCR4A = _BV(COM4A1) | _BV(WGM41)
+#if (D2A_CHANNELS > 1)
+			 | _BV(COM4B1)
+#endif
+#if (D2A_CHANNELS > 2)
+			 | _BV(COM4C1)
+#endif
+			 ;
+	TCCR4B = _BV(WGM43) | _BV(WGM42) | _BV(CS40);
+	ICR4 = D2A_FULL_SCALE;
+
+	DDRH |= _BV(D2A_PWM_BIT)
+#if (D2A_CHANNELS > 1)
+			| _BV(D2A_PWM2_BIT)
+#endif
+#if (D2A_CHANNELS > 2)
+			| _BV(D2A_PWM3_BIT)
+#endif
+			;
+
+	/* Set output to 0 initially */
+	WriteDtoASample(0);
+}
+
+/******************************************************************************
+ * This function writes a value to the first PWM output. Frames are just the
+ * value, so there's nothing to encode.
+ ******************************************************************************/
+void WriteDtoASample(unsigned int Value)
+{
+	OCR4A = Value;
+}
+
+/******************************************************************************
+ * This function writes a frame, as made by D2A_FRAME, to the first PWM
+ * output.
+ ******************************************************************************/
+void WriteDtoAFrame(unsigned int Frame)
+{
+	OCR4A = Frame;
+}
+
+/******************************************************************************
+ * Writes one frame to each of the first ucCount PWM outputs. They all take
+ * the new values at the start of the next PWM period, so there's no skew
+ * between them and nothing is left in flight.
+ ******************************************************************************/
+void WriteDtoABurst(const unsigned int *pFrames, unsigned char ucCount)
+{
+	unsigned char i;
+
+	for (i = 0; i < ucCount; i++)
+	{
+		*PwmCompares[i] = pFrames[i];
+	}
+}
+
+#else
+/* Chip select for each D/A channel */
+typedef struct
+{
+	volatile unsigned char *pPort;
+	volatile unsigned char *pDdr;
+	unsigned char ucMask;
+} ChipSelectType;
+
+static const ChipSelectType ChipSelects[D2A_CHANNELS] = {
+	{ &PORTB, &DDRB, _BV(D2A_CS_BIT) },
+#if (D2A_CHANNELS > 1)
+	{ &PORTB, &DDRB, _BV(D2A_CS2_BIT) },
+#endif
+#if (D2A_CHANNELS > 2)
+	{ &PORTL, &DDRL, _BV(D2A_CS3_BIT) },
+#endif
+#if (D2A_CHANNELS > 3)
+	{ &PORTL, &DDRL, _BV(D2A_CS4_BIT) },
+#endif
+};
+
+/* A burst is one frame for each channel, sent back to back. It is in flight
+ * from when its first byte is written until the SPI interrupt has sent the
+ * last, and ucBurstLength is 0 when the SPI is idle. */
+static unsigned int BurstFrames[D2A_CHANNELS];
+static volatile unsigned char ucBurstLength = 0;
+static volatile unsigned char ucBurstChannel;
+static volatile unsigned char ucBytesLeft = 0;	/* Of the present frame */
+
+/* Timer 1 counts when the burst started and the first D/A was loaded. Timer
+ * 1 restarts every sample period, so these time the burst within it. */
+static unsigned int uiBurstStart, uiFirstLatch;
+
+static void StartFrame(void);
 
 /******************************************************************************
  * This function initializes the A/D converter
  ******************************************************************************/
 void InitDtoA(void)
 {
+	unsigned char i;
+
     /* Set SPI Control register, with:
-     *   SPIE:  0 - SPI Interrupt disabled
+     *   SPIE:  1 - SPI Interrupt enabled
      *   SPE:   1 - SPI Enabled
      *   DORD:  0 - Data order is MS bit first
      *   MSTR:  1 - CPU is the master
@@ -37,22 +185,32 @@ void InitDtoA(void)
 	 *   SPR0:  1 - Sck frequency = Fosc/8
 	 *              when SPI2X is set to 1
 	 */
-	SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPR0);
+	SPCR = _BV(SPIE) | _BV(SPE) | _BV(MSTR) | _BV(SPR0) | D2A_SPI_MODE;
 	
 	/* Set SPI2X on SPSR to finish setting SCK frequency 
 	 * Note that since this only writable bit in this register is the SPI2X
 	 * bit, We can just write. */
 	SPSR = _BV(SPI2X);
 	
-	/* Set Port B, pin 4 to be an output. This is actually already done in 
+	/* Set the chip select pins to be outputs. PB4 is actually already done in
 	 * main.c, but I like to do it again here in case, sometime down the road,
 	 * it's not setup in main. Keep your configuration close to where it's needed.
+	 * And set them high, so no D/A is selected.
 	 */
-	SET_BIT(DDRB, D2A_CS_BIT);
-	
-	/* And set PB4 high, so D/A is not selected */
-	SET_BIT(PORTB, D2A_CS_BIT); 
+	for (i = 0; i < D2A_CHANNELS; i++)
+	{
+		*ChipSelects[i].pDdr |= ChipSelects[i].ucMask;
+		*ChipSelects[i].pPort |= ChipSelects[i].ucMask;
+	}
 	
+	/* Forget any burst that was being sent, and clear a transfer-complete
+	 * flag that's left over, so it isn't taken for the start of the next
+	 * frame. SPIF is cleared by reading SPSR, then SPDR. */
+	ucBurstLength = 0;
+	ucBytesLeft = 0;
+	(void)SPSR;
+	(void)SPDR;
+
 	/* Set D/A to 0 initially */
 	WriteDtoASample(0);
 }
@@ -60,13 +218,14 @@ void InitDtoA(void)
 /******************************************************************************
  * This function writes data to the D/A.
  *
- * Our interface is 12 bits. To match the format of our D/A, we need
- * to do a 16-bit write, with the following format, Most-Significant bits first:
- * 4 MS bits: dummy bits. Don't care.
- * 10 next MS bits: The value we want to write.
- * 2 LS bits: extra bits. Don't care.
+ * The value is put in the frame format of the D/A chosen by D2A_BITS (see
+ * dtoa.h), and the frame is sent Most-Significant bits first.
+ *
+ * The write doesn't wait for the SPI. It selects the D/A and sends the first
+ * byte, and the SPI interrupt sends the rest and unselects the D/A (see
+ * DtoAByteSent). The caller's time no longer depends on the SPI clock.
  *
- * Note: There are 2 errors that can be detected in our SPI system.
+ * Note: There are 3 errors that can be detected in our SPI system.
  *       Mode Fault:        This indicates two devices have tried to be a master
  *                          at the same time. This is determined to have
  *                          happened when we're a Master and the Slave Select
@@ -74,9 +233,12 @@ void InitDtoA(void)
  *                          drive the PD5_SS pin, this should never happen.
  *       Write Collision:   If we try to write a sample into the data register
  *                          before the last one has been transmitted, we'll see
- *                          this error. To prevent this, we must always check
- *                          that the data register is empty before writing to
- *                          it.
+ *                          this error. To prevent this, we never write to it
+ *                          while a frame is in flight.
+ *       Frame in flight:   A new sample arrived before the last frame was
+ *                          sent. The new sample is dropped rather than waited
+ *                          for.
+ * Each is counted, as well as reported.
  ******************************************************************************/
 /* This union is used so we can access the individual bytes of the passed-in
  * integer. The endianness of the processor will affect the order of the MSB
@@ -93,50 +255,250 @@ typedef union
 
 void WriteDtoASample(unsigned int Value)
 {
+	WriteDtoAFrame(D2A_FRAME(Value));
+}
+
+/******************************************************************************
+ * This function writes a sample that's already been put in the D/A's frame
+ * format, as made by D2A_FRAME, to the first D/A.
+ ******************************************************************************/
+void WriteDtoAFrame(unsigned int Frame)
+{
+	WriteDtoABurst(&Frame, 1);
+}
+
+/******************************************************************************
+ * Writes one frame to each of the first ucCount D/A channels, back to back.
+ * Only the first byte is written here; the SPI interrupt sends the rest, so
+ * the gap between channels is set by the SPI alone.
+ ******************************************************************************/
+void WriteDtoABurst(const unsigned int *pFrames, unsigned char ucCount)
+{
+	unsigned char i;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (ucBurstLength != 0)
+		{	/* Last burst is still going out. Don't wait for it, and don't
+			 * disturb it. */
+			++D2AStats.uiFramesInFlight;
+			ReportError(SPI_PREV_TX_INCOMPLETE);
+		}
+		else
+		{
+			for (i = 0; i < ucCount; i++)
+			{
+				BurstFrames[i] = pFrames[i];
+			}
+			ucBurstLength = ucCount;
+			ucBurstChannel = 0;
+			uiBurstStart = TCNT1;
+
+			StartFrame();
+		}
+	}
+}
+
+/******************************************************************************
+ * Selects the D/A for the present channel of the burst, and sends the first
+ * byte of its frame.
+ ******************************************************************************/
+static void StartFrame(void)
+{
+	const ChipSelectType *pChipSelect = &ChipSelects[ucBurstChannel];
+#if (D2A_FRAME_BYTES == 2)
+	SampleType Sample;
+#endif
+
+	ucBytesLeft = D2A_FRAME_BYTES - 1;
+
+	/* Select D/A */
+	*pChipSelect->pPort &= ~pChipSelect->ucMask;
+
+	/* Check for errors by reading the status register. Reading it, then
+	 * writing the data register, clears the flag. */
+	if ((SPSR & _BV(WCOL)) != 0)
+	{
+		++D2AStats.uiWriteCollisions;
+		ReportError(SPI_WRITE_COLLISION);
+	}
+
+	/* Write the first byte to the D/A. The SPI interrupt does the rest. */
+#if (D2A_FRAME_BYTES == 3)
+	SPDR = D2A_FRAME_PREFIX;
+#else
+	Sample.WholeInt = BurstFrames[ucBurstChannel];
+	SPDR = Sample.Bytes.MSB;
+#endif
+}
+
+/******************************************************************************
+ * Called from the SPI interrupt when a byte has been sent. Sends the next
+ * byte of the frame, or, once the last has gone, unselects the D/A, which
+ * loads it, and starts the next channel's frame.
+ *
+ * A mode fault clears MSTR, which drops the SPI out of master mode. If that
+ * has happened, the burst is abandoned and master mode is restored.
+ ******************************************************************************/
+void DtoAByteSent(void)
+{
+	const ChipSelectType *pChipSelect = &ChipSelects[ucBurstChannel];
+	unsigned char ucChannel = ucBurstChannel;
+	unsigned int uiLatch;
 	SampleType Sample;
-    unsigned char ucSPIStatus;
-
-	// Load output value into union
-	Sample.WholeInt = Value << 2;
-
-    /* Select D/A */
-	CLEAR_BIT(PORTB, D2A_CS_BIT); 
-
-    /* Read status register to see if any errors are set, and to clear any 
-     * pending issues that prevent writing to the SPI. We do this before we
-     * enable the SPI, so that if a Mode Fault exists, it will be cleared
-     * when we write to the SPCR register. */
-    ucSPIStatus = SPSR;
-
-	/* Check for errors by reading the status register */
-    if ((SPSR & _BV(WCOL)) != 0) 
-    {   /* Write collision error. Since we're not writing to the SPI Data
-         * register while a trasmission is in progress, we should never see
-         * this. */
-        ReportError(SPI_WRITE_COLLISION);
-    }
-
-	/* Write value to D/A. */
-    SPDR = Sample.Bytes.MSB;
-
-    /* Wait for first byte to be transmitted */
-	/* Note: We really should never perform a wait like this in a non-preemptible
-	 * scheduler, since if the Tx is never complete, we'll stay here forever.
-	 * Better to use the SPI Interrupt, or to time out at some point. */
-    while ((SPSR & _BV(SPIF)) == 0);
-
-	/* Check for errors */
-    if ((SPSR & _BV(WCOL)) != 0) 
-    {
-        ReportError(SPI_WRITE_COLLISION);
-    }
-
-    /* Now write 2nd byte */
-    SPDR = Sample.Bytes.LSB;
-
-    /* Again, wait for transmission to be complete before disabling SPI */
-    while ((SPSR & _BV(SPIF)) == 0);
-
-    /* Unselect D/A */
-	SET_BIT(PORTB, D2A_CS_BIT);
+
+	if ((SPSR & _BV(WCOL)) != 0)
+	{
+		++D2AStats.uiWriteCollisions;
+		ReportError(SPI_WRITE_COLLISION);
+	}
+
+	if ((SPCR & _BV(MSTR)) == 0)
+	{	// Mode fault
+		++D2AStats.uiModeFaults;
+		ReportError(SPI_MODE_FAULT);
+		SET_BIT(SPCR, MSTR);
+
+		*pChipSelect->pPort |= pChipSelect->ucMask;
+		ucBurstLength = 0;
+	}
+	else if (ucBytesLeft != 0)
+	{	/* Now write the next byte */
+		Sample.WholeInt = BurstFrames[ucChannel];
+#if (D2A_FRAME_BYTES == 3)
+		if (--ucBytesLeft != 0)
+		{
+			SPDR = Sample.Bytes.MSB;
+		}
+		else
+#else
+		--ucBytesLeft;
+#endif
+		{
+			SPDR = Sample.Bytes.LSB;
+		}
+	}
+	else
+	{	/* Frame is done. Unselect D/A, which loads the new value */
+		*pChipSelect->pPort |= pChipSelect->ucMask;
+
+		uiLatch = TCNT1;
+		if (ucChannel == 0)
+		{
+			uiFirstLatch = uiLatch;
+		}
+		D2AStats.uiChannelSkew[ucChannel] = uiLatch - uiFirstLatch;
+
+		if (++ucChannel < ucBurstLength)
+		{	// On to the next channel
+			ucBurstChannel = ucChannel;
+			StartFrame();
+		}
+		else
+		{	// Burst is done
+			D2AStats.uiBurstTime = uiLatch - uiBurstStart;
+			ucBurstLength = 0;
+		}
+	}
+}
+
+#endif /* D2A_PWM */
+
+/******************************************************************************
+ * Returns the counts of D/A write errors, and the timing of the last burst.
+ ******************************************************************************/
+void GetDtoAStats(D2AStatsType *pStats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*pStats = D2AStats;
+	}
+}
+
+#if defined (D2A_CALIBRATION)
+/******************************************************************************
+ * Reads the calibration of a D/A from EEPROM. If there isn't a good one,
+ * the D/A is taken to be perfect and FALSE is returned.
+ ******************************************************************************/
+eBooleanType ReadDtoACal(unsigned char ucChannel, D2ACalType *pCal)
+{
+	D2ACalRecordType Record;
+	eBooleanType bValid = FALSE;
+	unsigned char i;
+
+	eeprom_read_block(&Record, &CalRecords[ucChannel], sizeof(Record));
+
+	if (Record.ucCheck == CalCheck(&Record.Cal))
+	{
+		*pCal = Record.Cal;
+		bValid = TRUE;
+	}
+	else
+	{	// Nothing to correct
+		pCal->iOffset = 0;
+		pCal->iGainError = 0;
+		for (i = 0; i < D2A_CAL_POINTS; i++)
+		{
+			pCal->scInl[i] = 0;
+		}
+	}
+
+	return bValid;
+}
+
+/******************************************************************************
+ * Queues the calibration of a D/A to be saved to EEPROM. Each byte takes
+ * about 3.3 ms to write, so ServiceDtoACal writes them a byte at a time
+ * from the foreground. A record that's still being written is started again.
+ ******************************************************************************/
+void WriteDtoACal(unsigned char ucChannel, const D2ACalType *pCal)
+{
+	CalPending[ucChannel].Cal = *pCal;
+	CalPending[ucChannel].ucCheck = CalCheck(pCal);
+	CalBytesLeft[ucChannel] = sizeof(D2ACalRecordType);
+}
+
+/******************************************************************************
+ * Writes the next byte of a queued calibration record, if the EEPROM isn't
+ * busy with the last one. Called from the foreground loop; it never waits.
+ * Only bytes that have changed are written. The check byte is last, so a
+ * record that's only half written isn't taken as good.
+ ******************************************************************************/
+void ServiceDtoACal(void)
+{
+	unsigned char ucChannel, ucByte;
+
+	if (!eeprom_is_ready())
+	{	// Still writing
+		return;
+	}
+
+	for (ucChannel = 0; ucChannel < D2A_CHANNELS; ucChannel++)
+	{
+		if (CalBytesLeft[ucChannel] != 0)
+		{
+			ucByte = sizeof(D2ACalRecordType) - CalBytesLeft[ucChannel]--;
+			eeprom_update_byte((uint8_t *)&CalRecords[ucChannel] + ucByte,
+							   ((uint8_t *)&CalPending[ucChannel])[ucByte]);
+			break;
+		}
+	}
+}
+
+/******************************************************************************
+ * Returns the check byte for a calibration record.
+ ******************************************************************************/
+static unsigned char CalCheck(const D2ACalType *pCal)
+{
+	const unsigned char *pByte = (const unsigned char *)pCal;
+	unsigned char ucCheck = D2A_CAL_CHECK_SEED;
+	unsigned char i;
+
+	for (i = 0; i < sizeof(D2ACalType); i++)
+	{
+		ucCheck = (ucCheck << 1 | ucCheck >> 7) ^ *pByte++;
+	}
+
+	return ucCheck;
 }
+#endif /* D2A_CALIBRATION */
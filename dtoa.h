@@ -9,12 +9,145 @@
  * 17Mar02	R Weber		Original file.
  * 24Feb03  R Weber     Made WriteDtoASample use a ptr, rather than a value, to
  *                      increase speed.
+ * 16Oct26	agent		Added D2A_BITS, D2A_CHANNELS, D2A_PWM and the
+ *						calibration record.
  ******************************************************************************/
 #if !defined(DTOA_H)	/* Prevents including this file multiple times */
 #define DTOA_H
 
+#if defined (D2A_PWM)
+/* With D2A_PWM, there's no D/A on the SPI bus. Instead, each channel is a
+ * fast PWM output of Timer 4 (OC4A, OC4B and OC4C, on Port H), followed by
+ * an RC filter, and D2A_BITS is the PWM resolution. The PWM period is
+ * 2^D2A_BITS clocks, so each extra bit halves the carrier:
+ *
+ *   D2A_BITS    F_CPU = 1 MHz     4 MHz      8 MHz      16 MHz
+ *      8           3906 Hz      15625 Hz   31250 Hz   62500 Hz
+ *      9           1953          7812      15625      31250
+ *     10            977          3906       7812      15625
+ *     11            488          1953       3906       7812
+ *     12            244           977       1953       3906
+ *
+ * A new duty cycle only takes effect at the start of a PWM period, so the
+ * sample rate is held to the carrier (see MAX_SAMPLE_RATE), and the carrier
+ * must be at least MIN_SAMPLE_RATE. The filter has to pass the signal and
+ * take out the carrier, which is easiest with the carrier well above the
+ * highest output frequency: at 8 MHz, 9 or 10 bits is the usual choice.
+ * The duty cycle is written straight to the compare register, so a frame
+ * is just the value. */
+#if !defined (D2A_BITS)
+#define D2A_BITS					10
+#endif
+
+#if (D2A_BITS < 8) || (D2A_BITS > 12)
+#error "D2A_BITS must be from 8 to 12 for a PWM output"
+#endif
+
+#define D2A_PWM_CARRIER				(F_CPU >> D2A_BITS)
+#define D2A_FRAME_SHIFT				0
+#define D2A_FRAME_COMMAND			0x0000
+#define D2A_FRAME_BYTES				0		// No SPI transfer
+#else
+/* Resolution of the D/A, in bits, and the largest value it accepts. The
+ * build picks one of the supported D/As with D2A_BITS:
+ *   10: TLC5615. 16-bit frame: 4 dummy bits, the value, and 2 extra bits
+ *       that are ignored.
+ *   12: MCP4921. 16-bit frame: 4 command bits (DAC A, unbuffered, 1x gain,
+ *       active), then the value.
+ *   16: DAC8551. 24-bit frame: a command byte (normal operation), then the
+ *       value.
+ * D2A_FRAME turns a value into the 16 bits of the frame after any command
+ * byte (D2A_FRAME_PREFIX), and D2A_FRAME_BYTES is the length of the whole
+ * frame. Everything is fixed at compile time, so the sample path never
+ * looks at the format. */
+#if !defined (D2A_BITS)
+#define D2A_BITS					10
+#endif
+
+#if (D2A_BITS == 10)
+#define D2A_FRAME_SHIFT				2
+#define D2A_FRAME_COMMAND			0x0000
+#define D2A_FRAME_BYTES				2
+#define D2A_SPI_MODE				0
+#elif (D2A_BITS == 12)
+#define D2A_FRAME_SHIFT				0
+#define D2A_FRAME_COMMAND			0x3000
+#define D2A_FRAME_BYTES				2
+#define D2A_SPI_MODE				0
+#elif (D2A_BITS == 16)
+#define D2A_FRAME_SHIFT				0
+#define D2A_FRAME_COMMAND			0x0000
+#define D2A_FRAME_PREFIX			0x00
+#define D2A_FRAME_BYTES				3
+#define D2A_SPI_MODE				_BV(CPHA)	// Data latched on falling SCK
+#else
+#error "D2A_BITS must be 10, 12 or 16"
+#endif
+#endif /* D2A_PWM */
+
+#define D2A_FULL_SCALE				((1UL << D2A_BITS) - 1)
+#define D2A_FRAME(Value)			(((unsigned int)(Value) << D2A_FRAME_SHIFT) |	\
+									 D2A_FRAME_COMMAND)
+
+/* Number of D/As on the SPI bus, each with its own chip select and its own
+ * signal. All of them are written, one after the other, every sample. With
+ * D2A_PWM, the number of PWM outputs. */
+#if !defined (D2A_CHANNELS)
+#define D2A_CHANNELS				1
+#endif
+
+#if (D2A_CHANNELS < 1) || (D2A_CHANNELS > 4)
+#error "D2A_CHANNELS must be from 1 to 4"
+#endif
+
+#if defined (D2A_PWM) && (D2A_CHANNELS > 3)
+#error "Timer 4 has only 3 PWM outputs"
+#endif
+
+/* Counts of D/A write errors, and the timing of the last burst in Timer 1
+ * counts. The skew is from loading the first D/A to loading each one. */
+typedef struct
+{
+	unsigned int uiWriteCollisions;
+	unsigned int uiModeFaults;
+	unsigned int uiFramesInFlight;	/* Samples dropped: last burst not sent */
+	unsigned int uiBurstTime;		/* Start of burst to loading the last D/A */
+	unsigned int uiChannelSkew[D2A_CHANNELS];
+} D2AStatsType;
+
+#if defined (D2A_CALIBRATION)
+/* Measured errors of one D/A, kept in EEPROM. The signal generator corrects
+ * for them when it builds its gains (see sine.c), so a calibrated output
+ * costs the sample ISR nothing. The INL errors are what's left at
+ * D2A_CAL_POINTS evenly spaced codes, from 0 to full scale, once the offset
+ * and gain have been taken out; between points the error is taken to be a
+ * straight line. */
+#define D2A_CAL_SEGMENT_BITS		3
+#define D2A_CAL_POINTS				((1 << D2A_CAL_SEGMENT_BITS) + 1)
+#define D2A_CAL_MAX_OFFSET			1000		// LSB
+#define D2A_CAL_MAX_GAIN_ERROR		1000		// 10.00%
+
+typedef struct
+{
+	int iOffset;						/* LSB */
+	int iGainError;						/* Hundredths of a percent */
+	signed char scInl[D2A_CAL_POINTS];	/* LSB */
+} D2ACalType;
+#endif
+
 /* Function Prototypes */
 void InitDtoA(void);
 void WriteDtoASample(unsigned int);
+void WriteDtoAFrame(unsigned int);
+void WriteDtoABurst(const unsigned int *, unsigned char);
+#if !defined (D2A_PWM)
+void DtoAByteSent(void);
+#endif
+void GetDtoAStats(D2AStatsType *);
+#if defined (D2A_CALIBRATION)
+eBooleanType ReadDtoACal(unsigned char, D2ACalType *);
+void WriteDtoACal(unsigned char, const D2ACalType *);
+void ServiceDtoACal(void);
+#endif
 
 #endif /* DTOA_H */
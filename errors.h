@@ -9,6 +9,7 @@
  * 16Mar02	R Weber		Original file.
  * 18Feb04	T Lill		modified for Winter 04 session
  * 18May08	T Lill		deleted redundant error symbol.
+ * 16Oct26	agent		Added EVENT_QUEUE_OVERFLOW.
  ******************************************************************************/
 #if !defined(ERRORS_H)		/* Prevents including this file multiple times */
 #define ERRORS_H
@@ -43,7 +44,10 @@ typedef enum
 
 	// Parameter errors
     INVALID_PARAMETER,
-    PARAMETER_OUT_OF_RANGE
+    PARAMETER_OUT_OF_RANGE,
+
+	// Foreground faults
+	EVENT_QUEUE_OVERFLOW
 } eErrorType;
 
 /* Function Prototypes */
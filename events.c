@@ -0,0 +1,70 @@
+/******************************************************************************
+ * File Name:	events.c
+ * Program:		Project for Real-Time Embedded Systems Programming class
+ * Author:		agent
+ * Purpose:		Queue of events from the interrupts to the foreground loop,
+ *				so slow tasks such as the menu run with interrupts enabled.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <util/atomic.h>
+
+#include "lib.h"
+#include "errors.h"
+#include "events.h"
+
+/* The foreground loop is the only reader, and only it moves ucEventTail.
+ * Writers only move ucEventHead, after the event is stored, so the reader
+ * never sees a half-written entry and never has to disable interrupts.
+ * Both indexes are single bytes, so each is read and written in one go.
+ * There can be more than one writer, though (an ISR that has re-enabled
+ * interrupts can be interrupted by one that posts too), so posting holds
+ * off interrupts for the few clocks it takes to claim a slot. */
+static volatile unsigned char EventQueue[EVENT_QUEUE_SIZE];
+static volatile unsigned char ucEventHead = 0;
+static volatile unsigned char ucEventTail = 0;
+
+/******************************************************************************
+ * Adds an event to the queue. If it's full, the event is dropped and an
+ * error is reported.
+ ******************************************************************************/
+void PostEvent(eEventType Event)
+{
+	unsigned char ucHead, ucNext;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ucHead = ucEventHead;
+		ucNext = (ucHead + 1) & (EVENT_QUEUE_SIZE - 1);
+		if (ucNext == ucEventTail)
+		{	// Full. The foreground has fallen behind.
+			ReportError(EVENT_QUEUE_OVERFLOW);
+		}
+		else
+		{
+			EventQueue[ucHead] = Event;
+			ucEventHead = ucNext;
+		}
+	}
+}
+
+/******************************************************************************
+ * Takes the oldest event off the queue. Returns FALSE if there isn't one.
+ * Only called from the foreground loop.
+ ******************************************************************************/
+eBooleanType GetEvent(eEventType *pEvent)
+{
+	unsigned char ucTail = ucEventTail;
+	eBooleanType bFound = FALSE;
+
+	if (ucTail != ucEventHead)
+	{
+		*pEvent = (eEventType)EventQueue[ucTail];
+		ucEventTail = (ucTail + 1) & (EVENT_QUEUE_SIZE - 1);
+		bFound = TRUE;
+	}
+
+	return bFound;
+}
@@ -0,0 +1,33 @@
+/******************************************************************************
+ * File Name:	events.h
+ * Program:		Project for Real-Time Embedded Systems Programming class
+ * Author:		agent
+ * Purpose:		Header file for events.c file. Queue of events posted by the
+ *				interrupts for the foreground loop to handle.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#if !defined(EVENTS_H)		/* Prevents including this file multiple times */
+#define EVENTS_H
+
+#include "lib.h"
+
+/* Things the foreground has to do. Posting one is quick, so it can be done
+ * from an ISR; the slow work is done when main takes it off the queue. */
+typedef enum {
+	EVENT_MENU_TICK,		/* Time for the menu's next pass */
+	EVENT_RX_LINE,			/* A command line has been received */
+	EVENT_SHOW_SAMPLE,		/* SLOW_SINE sample waiting to be printed */
+	NUM_EVENTS
+} eEventType;
+
+/* Events that can be waiting. Must be a power of 2. */
+#define EVENT_QUEUE_SIZE		16
+
+/* Function Prototypes */
+void PostEvent(eEventType);
+eBooleanType GetEvent(eEventType *);
+
+#endif /* EVENTS_H */
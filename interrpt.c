@@ -16,11 +16,16 @@
  * 25 May 06	T Lill		Replaced SIGNAL with ISR.
  * 31 Oct 07 	T Lill		Deleted OSC_FREQ symbol, replace with F_CPU in makefile.
  * 17 Oct 10	T Lill		Modified program for ATmega2560 processor.
+ * 16 Oct 26	agent		Timer 1 rate set by SetTimer1Period, and the
+ *							sample written first. Medium-thread tasks run
+ *							from a countdown table. Added SAMPLE_JITTER and
+ *							profiling.
  ******************************************************************************/
 
 /********************************* Includes ***********************************/
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "interrpt.h"
 #include "heartbeat.h"
@@ -28,13 +33,14 @@
 #include "lib.h"
 #include "menu.h"
 #include "serial.h"
+#include "sine.h"
+#include "dtoa.h"
+#include "profile.h"
 
 // Define execution times for interrupts
 /* Update rate of Main Timer in seconds */
 #define TIMER0_SCALER			1024
 
-// "Medium" thread time set to every 25 mSecs.
-#define TIMER0_TIME             0.025
 /* The following calculates how many counts are needed to achieve the desired
  * rate. There is no checking on the resulting value, which must be less than
  * 255. 
@@ -42,18 +48,50 @@
  */
 #define TIMER0_CNT				((TIMER0_TIME * F_CPU)/TIMER0_SCALER)
 
-/* Define times for the various medium-thread tasks, based on how often
- * the thread's interrupt occurs. */
-#define HEARTBEAT_TIME          0.5     /* seconds between toggling of LED */
-#define MENU_TIME               0.1     /* seconds between running menu */
-#define MAX_MEDIUM_THREAD_TIME  5       /* max # of mSecs for any task */
+/* Most tasks that can be run by the medium thread */
+#define MAX_MEDIUM_TASKS		6
 
-extern void UpdateSignal();
-extern int FreqDesired;
+/* Timer 1 sets the sample rate, which is planned in sine.c for each
+ * frequency. CTC mode counts OCR1A + 1 clocks per interrupt. F_CPU is
+ * rarely a multiple of the sample rate, so the fraction of a count left over
+ * (in 1/65536ths) is accumulated and the period is stretched by one count
+ * each time it carries. The average sample rate is then exact to within
+ * 1/65536 of a count. It starts at the highest rate, with prescaler 1. */
+#define TIMER1_CNT				((F_CPU / MAX_SAMPLE_RATE) - 1)
+#define TIMER1_FRAC				(unsigned int)((((unsigned long long)F_CPU << 16) \
+												/ MAX_SAMPLE_RATE) & 0xFFFF)
 
 /******************************************************************************
  * global variables
  *****************************************************************************/
+/* Tasks run by the medium thread. Each counts down the ticks to its next
+ * run, so the ISR only has to decrement and test, never divide. Tasks are
+ * only added, so the count is the one thing the ISR has to see change
+ * atomically. */
+typedef struct
+{
+	void (*pTask)(void);
+	unsigned char ucPeriod;			/* Ticks between runs */
+	unsigned char ucCountdown;		/* Ticks to the next run */
+	eBooleanType bEnabled;
+} MediumTaskType;
+
+static MediumTaskType MediumTasks[MAX_MEDIUM_TASKS];
+static volatile unsigned char ucMediumTasks = 0;
+
+#if !defined (SLOW_SINE)
+/* Timer 1 period, as whole counts (less one) and 1/65536ths of a count */
+static volatile unsigned int uiTimer1Count = TIMER1_CNT;
+static volatile unsigned int uiTimer1Frac = TIMER1_FRAC;
+#endif
+
+#if defined (SAMPLE_JITTER)
+/* Histogram of the sample interrupt's latency: Timer 1 counts from the
+ * compare match to the ISR reading TCNT1, in bins of JITTER_BIN_COUNTS. The
+ * last bin also holds everything longer. */
+static unsigned long ulJitterBins[JITTER_BINS];
+static unsigned int uiJitterMax;
+#endif
 
 /******************************************************************************
  * Function prototypes
@@ -105,14 +143,30 @@ void ISR_InitTimer0()
 }
 
 #if !defined (SLOW_SINE)
+/* Sets the Timer 1 clock select bits (CS12:CS10) and period. The counter is
+ * restarted, so a shorter period can't leave it past the new compare value.
+ */
+void SetTimer1Period(unsigned char ucClockSelect, unsigned int uiCount,
+					 unsigned int uiFrac)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uiTimer1Count = uiCount;
+		uiTimer1Frac = uiFrac;
+		TCCR1B = _BV(WGM12) | (ucClockSelect & (_BV(CS12) | _BV(CS11) | _BV(CS10)));
+		OCR1A = uiCount;
+		TCNT1 = 0;
+	}
+}
+
 void ISR_InitTimer1()
 {
 	// Set timer 1 to CTC mode
 	// Set prescaler to 1
 	TCCR1B  = _BV(WGM12) | _BV(CS10);
    
-	// Initialize compare register for freq desired
-	OCR1A = F_CPU / (FreqDesired * 100);
+	// Initialize compare register for the sample rate
+	OCR1A = TIMER1_CNT;
 
 	// Enable overflow interrupt A
 	TIMSK1 = _BV(OCIE1A);
@@ -123,16 +177,111 @@ void ISR_InitTimer1()
 }
 #endif /* !SLOW_SINE */
 
+/******************************************************************************
+ * Adds a task for the medium thread to run every ucPeriod ticks of
+ * TIMER0_TIME (see MEDIUM_TICKS). Tasks run in the order they're added,
+ * and start enabled.
+ *****************************************************************************/
+eErrorType AddMediumTask(void (*pTask)(void), unsigned char ucPeriod)
+{
+	eErrorType ReturnVal = NO_ERROR;
+	MediumTaskType *pNew;
+
+	if ((ucPeriod == 0) || (ucMediumTasks >= MAX_MEDIUM_TASKS))
+	{	// Table is full, or the task would never run
+		ReturnVal = PARAMETER_OUT_OF_RANGE;
+	}
+	else
+	{
+		pNew = &MediumTasks[ucMediumTasks];
+		pNew->pTask = pTask;
+		pNew->ucPeriod = ucPeriod;
+		pNew->ucCountdown = ucPeriod;
+		pNew->bEnabled = TRUE;
+
+		// Only now let the ISR see it
+		ucMediumTasks = ucMediumTasks + 1;
+	}
+
+	return ReturnVal;
+}
+
+#if defined (SAMPLE_JITTER)
+/******************************************************************************
+ * Copies the sample-latency histogram (JITTER_BINS counts) and returns the
+ * longest latency seen, both in Timer 1 counts.
+ *****************************************************************************/
+unsigned int GetSampleJitter(unsigned long *pulBins)
+{
+	unsigned int uiMax;
+	unsigned char i;
+
+	for (i = 0; i < JITTER_BINS; i++)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			pulBins[i] = ulJitterBins[i];
+		}
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uiMax = uiJitterMax;
+	}
+
+	return uiMax;
+}
+
+/******************************************************************************
+ * Empties the sample-latency histogram.
+ *****************************************************************************/
+void ClearSampleJitter(void)
+{
+	unsigned char i;
+
+	for (i = 0; i < JITTER_BINS; i++)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			ulJitterBins[i] = 0;
+		}
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uiJitterMax = 0;
+	}
+}
+#endif /* SAMPLE_JITTER */
+
+/******************************************************************************
+ * Stops or restarts a medium-thread task. A stopped task keeps counting, so
+ * it picks up its old timing when it's restarted.
+ *****************************************************************************/
+void EnableMediumTask(void (*pTask)(void), eBooleanType bEnable)
+{
+	unsigned char i;
+
+	for (i = 0; i < ucMediumTasks; i++)
+	{
+		if (MediumTasks[i].pTask == pTask)
+		{
+			MediumTasks[i].bEnabled = bEnable;
+		}
+	}
+}
+
 /******************************************************************************
  * Interrupt handlers
  *****************************************************************************/
 /* 
- * This is the ISR that handles Timer 0 Compare interrupts.
+ * This is the ISR that handles Timer 0 Compare interrupts. The medium-thread
+ * tasks run with interrupts enabled, so they must be safe to interrupt.
  */
 ISR(TIMER0_COMPA_vect)
 {
-	static unsigned int uiMedThreadCount = 1;		
-	static eBooleanType bMedThreadInProgress = FALSE;
+	static volatile eBooleanType bMedThreadInProgress = FALSE;
+	MediumTaskType *pTask;
+	unsigned char i;
+	PROFILE_ENTER(PROFILE_TIMER0);
 
 	// Check for overrun. 
 	if (bMedThreadInProgress == TRUE)
@@ -144,62 +293,88 @@ ISR(TIMER0_COMPA_vect)
 	{   // No overrun. Continue tasks
 		bMedThreadInProgress = TRUE;
 
+		/* The tasks can take a while, so let the other interrupts in,
+		 * above all the sample interrupt. The in-progress flag is already
+		 * set, so if this one comes round again before the tasks are done,
+		 * it's caught as an overrun above rather than running them twice. */
+		sei();
+
 	/**************************************************************************
-	 * Update medium-thread main timer
+	 * Call the Medium thread tasks, when it's time
 	 **************************************************************************/
-		if (uiMedThreadCount >= (unsigned int)
-			(MAX_MEDIUM_THREAD_TIME/TIMER0_TIME))
-		{	/* Reset the interrupt counter */
-			uiMedThreadCount = 1;
-		}
-		else
+		for (i = 0, pTask = MediumTasks; i < ucMediumTasks; i++, pTask++)
 		{
-			++uiMedThreadCount;
+			if (--pTask->ucCountdown == 0)
+			{	// Due. Start counting to the next run.
+				pTask->ucCountdown = pTask->ucPeriod;
+				if (pTask->bEnabled == TRUE)
+				{
+					pTask->pTask();
+				}
+			}
 		}
 
-	/**************************************************************************
-	 * Call the Medium thread tasks, when it's time
-	 **************************************************************************/    
-       if ((uiMedThreadCount % (unsigned int) 
-             (HEARTBEAT_TIME/TIMER0_TIME)) == 0)
-        {
-            // Toggle the heartbeat LED
-            heartbeat();
-        }
-
-		// using the formula to calculate the number of counts needed to get the desired interrupt rate:
-	    // ( SignalPeriod (1/F) / Timer1 Update Rate ( ) / Samples Per Period )
-  
-       if ((uiMedThreadCount % (unsigned int)( ( TIMER0_CNT * TIMER0_SCALER / FreqDesired ) / 100 )) == 0)
-        {
-			UpdateSignal();
-        }
-        
-        if ((uiMedThreadCount % (unsigned int) 
-             (MENU_TIME/TIMER0_TIME)) == 0)
-        {
-            // Toggle the heartbeat LED
-            RunMenu();
-        }
         // Clear in-progress flag
         bMedThreadInProgress = FALSE;
     }   // End of medium thread tasks
+
+	PROFILE_EXIT(PROFILE_TIMER0);
 }
 
 #if !defined (SLOW_SINE)
 
 ISR(TIMER1_COMPA_vect)
 {
-	// Triggers when output compare = OCR1A
+	static unsigned int uiTimer1Error = 0;
+	unsigned int uiError;
+#if defined (SAMPLE_JITTER)
+	unsigned int uiLatency = TCNT1;		// First, so nothing else adds to it
+	unsigned char ucBin;
+#endif
+	PROFILE_ENTER(PROFILE_TIMER1);
+
+	/* Output the sample first, so the D/A is loaded a fixed time after the
+	 * interrupt. The new OCR1A only has to be in before the counter gets
+	 * there, well after this. */
 	UpdateSignal();
-}
 
-void UpdateFreqCnt(){
-	OCR1A = F_CPU / (FreqDesired * 100);
+#if defined (SAMPLE_JITTER)
+	ucBin = (uiLatency < JITTER_BINS * JITTER_BIN_COUNTS) ?
+			uiLatency / JITTER_BIN_COUNTS : JITTER_BINS - 1;
+	++ulJitterBins[ucBin];
+	if (uiLatency > uiJitterMax)
+	{
+		uiJitterMax = uiLatency;
+	}
+#endif
+
+	/* Triggers when output compare = OCR1A. The counter was cleared at
+	 * the match, so the new OCR1A sets the length of the period now running.
+	 * Make it one count longer whenever the error accumulator carries. */
+	uiError = uiTimer1Error + uiTimer1Frac;
+	OCR1A = uiTimer1Count + (uiError < uiTimer1Error);
+	uiTimer1Error = uiError;
+
+	PROFILE_EXIT(PROFILE_TIMER1);
 }
 
 #endif /* !SLOW_SINE */
 
+#if !defined (D2A_PWM)
+/*
+ * This is the ISR that handles SPI transfer-complete interrupts, which
+ * carry the D/A frame along.
+ */
+ISR(SPI_STC_vect)
+{
+	PROFILE_ENTER(PROFILE_SPI);
+
+	DtoAByteSent();
+
+	PROFILE_EXIT(PROFILE_SPI);
+}
+#endif
+
 /* This handler takes care of all unused interrupts
  */
 ISR(__vector_default)
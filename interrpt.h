@@ -10,17 +10,51 @@
  * 27Aug01	R Weber		Added interrupt for signal generation.
  *  2Sep01	R Weber		Added trap for unused interrupts.
  *  3Mar02  R Weber     Moved definition of vectors to here.
+ * 16Oct26	agent		Added SetTimer1Period, AddMediumTask,
+ *						EnableMediumTask, MEDIUM_TICKS and SAMPLE_JITTER.
  ******************************************************************************/
 #if !defined(INTERRPT_H)		/* Prevents including this file multiple times */
 #define INTERRPT_H
 #include <avr/interrupt.h>
 
+#include "errors.h"
+#include "lib.h"
+
+// "Medium" thread time set to every 25 mSecs.
+#define TIMER0_TIME             0.025
+
+/* Number of medium-thread ticks in a time in seconds, for AddMediumTask.
+ * Worked out by the compiler, so the float never reaches the program.
+ * A task's period and countdown are bytes, so a time that rounds to more
+ * than 255 ticks (or to none) stops the build with a negative bit-field
+ * width rather than being cut down to a byte. */
+#define MEDIUM_TICKS_RAW(Seconds)	((Seconds) / TIMER0_TIME + 0.5)
+#define MEDIUM_TICKS(Seconds)												\
+	((unsigned char)(sizeof(struct {										\
+		int iTicksFitAByte : ((MEDIUM_TICKS_RAW(Seconds) >= 1) &&			\
+							  (MEDIUM_TICKS_RAW(Seconds) < 256)) ? 1 : -1;	\
+	}) * 0 + MEDIUM_TICKS_RAW(Seconds)))
+
+/* With SAMPLE_JITTER, the sample ISR keeps a histogram of how long after
+ * each Timer 1 compare match it starts, which shows how long it's held off
+ * by the other interrupts. Latencies are in Timer 1 counts, so clocks times
+ * the prescaler. */
+#define JITTER_BINS				16
+#define JITTER_BIN_COUNTS		16
+
+#if defined (SAMPLE_JITTER) && defined (SLOW_SINE)
+#error "SAMPLE_JITTER needs the Timer 1 sample interrupt"
+#endif
+
 /* Interrupt prototypes */
 void ISR_InitTimer0(void);
 void ISR_InitTimer1(void);
-
-#if !defined (SLOW_SINE)
-void UpdateFreqCnt(void);
+void SetTimer1Period(unsigned char, unsigned int, unsigned int);
+eErrorType AddMediumTask(void (*)(void), unsigned char);
+void EnableMediumTask(void (*)(void), eBooleanType);
+#if defined (SAMPLE_JITTER)
+unsigned int GetSampleJitter(unsigned long *);
+void ClearSampleJitter(void);
 #endif
 
 #endif /* INTERRPT_H */
@@ -12,6 +12,7 @@
  *						Removed BYTE and WORD definitions.  Updated _itoa and 
  *						_atoi to allow negative numbers.  Added warning about 
  *						SET_BIT and optimization.
+ * 16Oct26	agent		Added port bits for the extra D/As and PWM outputs.
  ******************************************************************************/
 #if !defined(LIB_H)		/* Prevents including this file multiple times */
 #define LIB_H
@@ -28,6 +29,17 @@
 #define D2A_CS_BIT						4
 #define ERROR_LED_BIT					5
 #define TIMING_BIT						6
+// Port bit to use for the second D/A's chip select
+#define D2A_CS2_BIT						7
+
+// Define Port H uses: Timer 4 PWM outputs (OC4A to OC4C), with D2A_PWM
+#define D2A_PWM_BIT						3
+#define D2A_PWM2_BIT					4
+#define D2A_PWM3_BIT					5
+
+// Define Port L uses: chip selects for the third and fourth D/As
+#define D2A_CS3_BIT						0
+#define D2A_CS4_BIT						1
 
 /* Memory types */
 typedef unsigned char *MEMPTR;
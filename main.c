@@ -11,6 +11,8 @@
  * 06Oct05	T Lill		Removed deprecated functions
  * 05Dec07	T Lill		Updated heartbeat function.  Added missing initialization
  *						for SPI
+ * 16Oct26	agent		Foreground renders samples and handles the events
+ *						posted by the interrupts. Heartbeat is a medium-thread task.
  ******************************************************************************/
 #include "lib.h"
 #include "interrpt.h"
@@ -20,6 +22,12 @@
 #include "tempsensor.h"
 #include "sine.h"
 #include "dtoa.h"
+#include "menu.h"
+#include "profile.h"
+#include "events.h"
+
+/* Seconds between toggling of the heartbeat LED */
+#define HEARTBEAT_TIME          0.5
 
 /************************* Function Prototypes ******************************/
 int main(void);
@@ -34,7 +42,11 @@ int main(void);
  */
 void heartbeat(void)
 {
+	PROFILE_ENTER(PROFILE_HEARTBEAT);
+
 	asm volatile (" sbi	0x03, 0 ");	// see warning in lib.h about SET_BIT
+
+	PROFILE_EXIT(PROFILE_HEARTBEAT);
 }
 
 /*****************************************************************************
@@ -45,6 +57,8 @@ void heartbeat(void)
  *****************************************************************************/
 int main(void) 
 {
+	eEventType Event;
+
     // Disable interrupts
     cli();
 
@@ -52,8 +66,14 @@ int main(void)
 	DDRB = 0xFF;
 	PORTB = 0xFF;
 
-    /* Initialize the Timer 0 */
+#if defined (TASK_PROFILE)
+	// Start the timer that the profiled code is timed with
+	InitProfile();
+#endif
+
+    /* Initialize the Timer 0, and the medium-thread tasks it runs */
     ISR_InitTimer0();
+    AddMediumTask(heartbeat, MEDIUM_TICKS(HEARTBEAT_TIME));
 #if !defined (SLOW_SINE)
 	ISR_InitTimer1();
 #endif
@@ -66,6 +86,9 @@ int main(void)
 
 	// Initialize the sine wave
 	initSine();
+
+	// Start the menu
+	InitMenu();
 	
     /* Enable interrupts. Do as last initialization, so interrupts are
      * not initiated until all of initialization is complete. */
@@ -73,7 +96,34 @@ int main(void)
 
    for (; ; )		/* Foreground loops forever */
    {   // Do slow tasks here
-      
+      // Render samples for the sine wave ISR
+      ServiceSignal();
+#if defined (D2A_CALIBRATION)
+      // Save any new D/A calibration, a byte at a time
+      ServiceDtoACal();
+#endif
+
+      /* Then handle one event from the interrupts. Only one, so the samples
+       * are topped up again between slow tasks. */
+      if (GetEvent(&Event) == TRUE)
+      {
+         switch (Event)
+         {
+            case EVENT_MENU_TICK:
+            case EVENT_RX_LINE:
+               RunMenu();
+               break;
+
+#if defined (SLOW_SINE)
+            case EVENT_SHOW_SAMPLE:
+               ShowSample();
+               break;
+#endif
+
+            default:
+               break;
+         }
+      }
    }   /* end of endless loop */
 
    return 0;
@@ -11,6 +11,8 @@
  *                      buffer overflow without increasing Tx buffer size.
  * 29Sep05	T Lill		Editorial changes only.
  * 05Dec07	T Lill		Replaced "debug" prompt with "cmd"
+ * 16Oct26	agent		Added commands for voices, channels, sweeps, modulation,
+ *						calibration, capture and profiling. Runs in the foreground.
  ******************************************************************************/
 #include "string.h"
 #include "stdlib.h"
@@ -22,6 +24,12 @@
 #include "tempsensor.h"
 #include "sine.h"
 #include "dtoa.h"
+#include "interrpt.h"
+#include "profile.h"
+#include "events.h"
+
+/* Seconds between runs of the menu */
+#define MENU_TIME               0.1
 
 #define MAX_MEM_SIZE 0x40
 #define MAX_MEM_ADDR 0x4FF
@@ -36,13 +44,48 @@ typedef enum {
     DISPLAY_HELP_MENU4,
     DISPLAY_HELP_MENU5,
     DISPLAY_HELP_MENU6,
+    DISPLAY_HELP_MENU7,
+    DISPLAY_SIGNAL2,
+    DISPLAY_SIGNAL3,
+    DISPLAY_SIGNAL4,
+    DISPLAY_SIGNAL5,
+    DISPLAY_SIGNAL6,
+    DISPLAY_SIGNAL7,
+    DISPLAY_SIGNAL8,
 	GET_LCD_CHARACTER,
     GET_LCD_POSITION,
 	SIGNAL_READ_FREQUENCY,
 	SIGNAL_READ_VOLTAGE,
+	SIGNAL_READ_WAVEFORM,
+	SIGNAL_READ_RAMP,
+	USER_READ_POINT,
+	VOICE_READ_NUMBER,
+	VOICE_READ_FREQUENCY,
+	VOICE_READ_LEVEL,
+	VOICE_READ_PHASE,
+	CHANNEL_READ_NUMBER,
+	CHANNEL_READ_FREQUENCY,
+	CHANNEL_READ_VOLTAGE,
+	CHANNEL_READ_WAVEFORM,
+	SWEEP_READ_START,
+	SWEEP_READ_STOP,
+	SWEEP_READ_DURATION,
+	SWEEP_READ_TYPE,
+	MOD_READ_TYPE,
+	MOD_READ_RATE,
+	MOD_READ_DEPTH,
 	WRITE_D2A,
+	CAL_READ_VIEW,
+	CAL_READ_NUMBER,
+	CAL_READ_OFFSET,
+	CAL_READ_GAIN,
+	CAL_READ_INL,
 	MEMORY_GET_ADDRESS,
-	MEMORY_GET_LENGTH
+	MEMORY_GET_LENGTH,
+	DISPLAY_CAPTURE,
+	DISPLAY_CAL,
+	DISPLAY_PROFILE,
+	DISPLAY_JITTER
 } DebugMenuStateType;
 
 typedef enum {
@@ -50,6 +93,23 @@ typedef enum {
     WRITE_MEMORY
 } DebugMenuSubType;
 
+/******************************************************************************
+ * Medium-thread task that has the foreground run the menu.
+ ******************************************************************************/
+static void MenuTick(void)
+{
+    PostEvent(EVENT_MENU_TICK);
+}
+
+/******************************************************************************
+ * Starts the menu. The medium thread only asks for each pass; RunMenu
+ * itself is called from the foreground loop, with interrupts enabled.
+ ******************************************************************************/
+void InitMenu(void)
+{
+    AddMediumTask(MenuTick, MEDIUM_TICKS(MENU_TIME));
+}
+
 /******************************************************************************
  * Processes keypresses received via RS-232. Implements a menuing system.
  ******************************************************************************/
@@ -60,15 +120,75 @@ static DebugMenuStateType MenuState = TOP_MENU;
 
 int DisplaySamples = 0;
 
+#if defined (SIGNAL_CAPTURE)
+/* Captured samples being dumped, and the next one to send */
+static const unsigned int *pCapture;
+static unsigned int CaptureIndex;
+
+/* Samples sent per pass through the menu. Kept small enough that the serial
+ * port can send them before the next pass. */
+#define CAPTURE_PER_PASS	4
+#endif
+
+#if defined (D2A_CALIBRATION)
+/* D/A whose calibration is being shown or loaded, and the one being loaded */
+static unsigned char CalNumber;
+static D2ACalType Cal;
+static unsigned char CalPoint;
+#endif
+
+/* Point of the user waveform being loaded */
+static unsigned char UserPoint;
+
+#if defined (TASK_PROFILE)
+/* Line of the profile table being sent. The names are in eProfileType
+ * order. */
+static unsigned char ProfileIndex;
+static const char ProfileNames[NUM_PROFILES][8] PROGMEM = {
+	"timer0", "timer1", "spi", "sci rx", "sci tx",
+	"beat", "menu", "signal", "render"
+};
+#endif
+
+#if defined (SAMPLE_JITTER)
+/* Copy of the sample-latency histogram being sent, and the next bin. Copied
+ * when the dump starts, so the bins all cover the same samples. */
+static unsigned long JitterBins[JITTER_BINS];
+static unsigned char JitterIndex;
+
+/* Bins sent per pass through the menu */
+#define JITTER_PER_PASS		4
+#endif
+
+static eErrorType ReadTenths(char *, unsigned int *);
+static void WriteFrequencyRange(void);
+static void WriteDecimal(unsigned long, unsigned char);
+#if defined (D2A_CALIBRATION)
+static eErrorType ReadSigned(char *, int, int, int *);
+static void WriteSigned(int, unsigned char);
+#endif
+
 void RunMenu(void)
 {
     char cTempChar = 1;     // Set to any value other than 0
     char zOutputStr[MAX_MEM_SIZE + 3];  // Add space for newline, return and NULL
     char *ptrOutputStr;
     eErrorType error = NO_ERROR;
+    SignalPlanType Plan;
+    D2AStatsType D2AStats;
     static DebugMenuSubType MenuAction = READ_MEMORY;
 	static unsigned int i, Address = 0, Length = 0, Value = 0;
 	static unsigned int Frequency = 0, Voltage = 0;
+	static unsigned int VoiceNumber = 0, VoiceLevel = 0;
+#if (D2A_CHANNELS > 1)
+	static unsigned int ChannelNumber = 0;
+#endif
+	static unsigned int SweepStart = 0, SweepStop = 0, SweepTime = 0;
+	static unsigned int ModType = 0, ModRate = 0;
+#if defined (D2A_CALIBRATION)
+	int iValue;
+#endif
+	PROFILE_ENTER(PROFILE_MENU);
 
     // Read input characters until input buffer is empty
     while ((cTempChar = SCIReadChar()) != 0)
@@ -133,10 +253,8 @@ void RunMenu(void)
                         Voltage = GET_VOLT_DESIRED();
                         
                         SCIWriteString_P(PSTR("  Desired Frequency = "));
-                        ptrOutputStr = zOutputStr;
-                        _itoa(&ptrOutputStr, Frequency, 10);
-                        SCIWriteString(zOutputStr);
-                        SCIWriteString_P(PSTR("\n\r"));
+                        WriteDecimal(Frequency, 1);
+                        SCIWriteString_P(PSTR(" Hz\n\r"));
 
                         SCIWriteString_P(PSTR("  Desired Voltage = "));
                         ptrOutputStr = zOutputStr;
@@ -144,21 +262,8 @@ void RunMenu(void)
                         SCIWriteString(zOutputStr);
                         SCIWriteString_P(PSTR("\n\r"));
 
-                        // Retrieve signal parameters
-                        Frequency = GET_FREQ_ACTUAL();
-                        Voltage = GET_VOLT_ACTUAL();
-                        
-                        SCIWriteString_P(PSTR("  Actual Frequency = "));
-                        ptrOutputStr = zOutputStr;
-                        _itoa(&ptrOutputStr, Frequency, 10);
-                        SCIWriteString(zOutputStr);
-                        SCIWriteString_P(PSTR("\n\r"));
-
-                        SCIWriteString_P(PSTR("  Actual Voltage = "));
-                        ptrOutputStr = zOutputStr;
-                        _itoa(&ptrOutputStr, Voltage, 10);
-                        SCIWriteString(zOutputStr);
-                        SCIWriteString_P(PSTR("\n\r"));
+                        // The rest is sent a little at a time
+                        MenuState = DISPLAY_SIGNAL2;
                     }
 
                     else if (strcmp(zInputStr, "msp") == 0)
@@ -167,12 +272,177 @@ void RunMenu(void)
                         MenuState = SIGNAL_READ_VOLTAGE;
                     }
 
+                    else if (strcmp(zInputStr, "ramp") == 0)
+                    {   // Change how amplitude changes are ramped
+                        SCIWriteString_P(PSTR("  Enter periods to ramp amplitude over (0 to 255): "));
+                        MenuState = SIGNAL_READ_RAMP;
+                    }
+
+                    else if (strcmp(zInputStr, "wf") == 0)
+                    {   // Change waveform
+                        SCIWriteString_P(PSTR("  Enter waveform (0=sine 1=square 2=triangle 3=saw 4=user): "));
+                        MenuState = SIGNAL_READ_WAVEFORM;
+                    }
+
+                    else if (strcmp(zInputStr, "uw") == 0)
+                    {   // Load the user waveform, a point at a time
+                        UserPoint = 0;
+                        SCIWriteString_P(PSTR("  Enter user waveform point 0 (-100 to 100 %, Enter to stop): "));
+                        MenuState = USER_READ_POINT;
+                    }
+
+                    else if (strcmp(zInputStr, "mv") == 0)
+                    {   // Change one of the mixed voices
+                        SCIWriteString_P(PSTR("  Enter voice (1 to 3): "));
+                        MenuState = VOICE_READ_NUMBER;
+                    }
+
+#if (D2A_CHANNELS > 1)
+                    else if (strcmp(zInputStr, "ch") == 0)
+                    {   // Change the signal on one of the extra D/As
+                        SCIWriteString_P(PSTR("  Enter D/A channel (1 to "));
+                        WriteDecimal(D2A_CHANNELS - 1, 0);
+                        SCIWriteString_P(PSTR("): "));
+                        MenuState = CHANNEL_READ_NUMBER;
+                    }
+#endif
+
+                    else if (strcmp(zInputStr, "sw") == 0)
+                    {   // Sweep the frequency
+                        SCIWriteString_P(PSTR("  Enter start frequency "));
+                        WriteFrequencyRange();
+                        MenuState = SWEEP_READ_START;
+                    }
+
+                    else if (strcmp(zInputStr, "mod") == 0)
+                    {   // Modulate the output
+                        SCIWriteString_P(PSTR("  Enter modulation (0=none 1=AM 2=FM): "));
+                        MenuState = MOD_READ_TYPE;
+                    }
+
                     else if (strcmp(zInputStr, "wv") == 0)
                     {   // Change desired signal parameters
-                        SCIWriteString("  Enter desired voltage (0 to 1023): ");
+                        SCIWriteString_P(PSTR("  Enter desired voltage (0 to "));
+                        WriteDecimal(D2A_FULL_SCALE, 0);
+                        SCIWriteString_P(PSTR("): "));
                         MenuState = WRITE_D2A;
                     }
 
+#if defined (D2A_CALIBRATION)
+                    else if (strcmp(zInputStr, "cal") == 0)
+                    {   // Show the calibration of a D/A
+#if (D2A_CHANNELS > 1)
+                        SCIWriteString_P(PSTR("  Enter D/A channel (0 to "));
+                        WriteDecimal(D2A_CHANNELS - 1, 0);
+                        SCIWriteString_P(PSTR("): "));
+                        MenuState = CAL_READ_VIEW;
+#else
+                        CalNumber = 0;
+                        MenuState = DISPLAY_CAL;
+#endif
+                    }
+
+                    else if (strcmp(zInputStr, "ldcal") == 0)
+                    {   // Load the calibration of a D/A
+#if (D2A_CHANNELS > 1)
+                        SCIWriteString_P(PSTR("  Enter D/A channel (0 to "));
+                        WriteDecimal(D2A_CHANNELS - 1, 0);
+                        SCIWriteString_P(PSTR("): "));
+                        MenuState = CAL_READ_NUMBER;
+#else
+                        CalNumber = 0;
+                        SCIWriteString_P(PSTR("  Enter offset error (LSB): "));
+                        MenuState = CAL_READ_OFFSET;
+#endif
+                    }
+#endif
+
+#if defined (TASK_PROFILE)
+                    else if (strcmp(zInputStr, "prof") == 0)
+                    {   // Dump the execution times, one line per pass
+                        SCIWriteString_P(PSTR("  Task Runs Min Max Mean (clocks)\n\r"));
+                        ProfileIndex = 0;
+                        MenuState = DISPLAY_PROFILE;
+                    }
+
+                    else if (strcmp(zInputStr, "cprof") == 0)
+                    {
+                        ClearProfile();
+                    }
+#endif
+
+#if defined (SAMPLE_JITTER)
+                    else if (strcmp(zInputStr, "jit") == 0)
+                    {   // Dump the sample latency histogram
+                        unsigned int MaxLatency;
+
+                        MaxLatency = GetSampleJitter(JitterBins);
+                        GetSignalPlan(&Plan);
+                        SCIWriteString_P(PSTR("  Sample Latency (Timer 1 counts, prescaler "));
+                        WriteDecimal(Plan.uiPrescaler, 0);
+                        SCIWriteString_P(PSTR("), max "));
+                        WriteDecimal(MaxLatency, 0);
+                        SCIWriteString_P(PSTR("\n\r"));
+                        JitterIndex = 0;
+                        MenuState = DISPLAY_JITTER;
+                    }
+
+                    else if (strcmp(zInputStr, "cjit") == 0)
+                    {
+                        ClearSampleJitter();
+                    }
+#endif
+
+#if defined (SIGNAL_CAPTURE)
+                    else if (strcmp(zInputStr, "cap") == 0)
+                    {   // Capture the output for measurement
+                        StartCapture();
+                    }
+
+                    else if (strcmp(zInputStr, "dcap") == 0)
+                    {   // Dump the capture, one "key=value" per line
+                        unsigned int Cycles;
+
+                        if (GetCapture(&pCapture, &Cycles) == FALSE)
+                        {
+                            SCIWriteString_P(PSTR("  Capture not complete\n\r"));
+                        }
+                        else
+                        {
+                            GetSignalPlan(&Plan);
+                            SCIWriteString_P(PSTR("capture=1\n\rsample_rate="));
+                            WriteDecimal(Plan.ulSampleRate, 0);
+                            SCIWriteString_P(PSTR("\n\rfrequency="));
+                            WriteDecimal(GET_FREQ_ACTUAL(), 2);
+                            SCIWriteString_P(PSTR("\n\rvoltage="));
+                            WriteDecimal(GET_VOLT_ACTUAL(), 2);
+                            SCIWriteString_P(PSTR("\n\rwaveform="));
+                            WriteDecimal(GET_WAVEFORM(), 0);
+                            SCIWriteString_P(PSTR("\n\rtable_size="));
+                            WriteDecimal(SAMPLES_PER_PERIOD, 0);
+#if defined (DDS_INTERPOLATE)
+                            SCIWriteString_P(PSTR("\n\rinterpolate=1\n\rd2a_bits="));
+#else
+                            SCIWriteString_P(PSTR("\n\rinterpolate=0\n\rd2a_bits="));
+#endif
+                            WriteDecimal(D2A_BITS, 0);
+#if defined (SIGNAL_DITHER)
+                            SCIWriteString_P(PSTR("\n\rdither=1"));
+#else
+                            SCIWriteString_P(PSTR("\n\rdither=0"));
+#endif
+                            SCIWriteString_P(PSTR("\n\rcycles_per_sample="));
+                            WriteDecimal(Cycles, 0);
+                            SCIWriteString_P(PSTR("\n\rsamples="));
+                            WriteDecimal(CAPTURE_SIZE, 0);
+                            SCIWriteString_P(PSTR("\n\r"));
+
+                            CaptureIndex = 0;
+                            MenuState = DISPLAY_CAPTURE;
+                        }
+                    }
+#endif
+
                     else if (strcmp(zInputStr, "ds") == 0)
                     {   // Display A/D Samples
                         SCIWriteString("  Hit Enter key to terminate\n\r");
@@ -239,7 +509,7 @@ void RunMenu(void)
                     {   // Just skip NULL entries
                         Voltage = _atoi(zInputStr, 10);
 
-						if ((Voltage >= 0) && (Voltage <= 1023))
+						if (Voltage <= D2A_FULL_SCALE)
 						{	// Valid voltage. Write to D/A
 							WriteDtoASample(Voltage);
 						}
@@ -254,7 +524,8 @@ void RunMenu(void)
                         Voltage = _atoi(zInputStr, 10);
 
                         // Now get frequency
-                        SCIWriteString_P(PSTR("\n\r  Enter desired frequency (40 to 100): "));
+                        SCIWriteString_P(PSTR("\n\r  Enter desired frequency "));
+                        WriteFrequencyRange();
                         MenuState = SIGNAL_READ_FREQUENCY;
                     }
                     else
@@ -267,10 +538,12 @@ void RunMenu(void)
                 case SIGNAL_READ_FREQUENCY:
                     if (zInputStr[0] != '\0')
                     {   // Just skip NULL entries
-                        Frequency = _atoi(zInputStr, 10);
-
                         // Set the parameters
-                        if ((error = SetFreq(Frequency)) != NO_ERROR)
+                        if (ReadTenths(zInputStr, &Frequency) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid frequency"));
+                        }
+                        else if ((error = SetFreq(Frequency)) != NO_ERROR)
                         {
                             SCIWriteString_P(PSTR("\n\r  Error setting frequency"));
                         }
@@ -290,6 +563,456 @@ void RunMenu(void)
                         // Back to top menu
                         MenuState = TOP_MENU;
                     }
+                    break;
+
+                case SIGNAL_READ_WAVEFORM:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (SetWaveform((eWaveformType)_atoi(zInputStr, 10)) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error setting waveform"));
+                        }
+                    }
+                    // Back to top menu
+                    MenuState = TOP_MENU;
+                    break;
+
+                case SIGNAL_READ_RAMP:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        Value = _atoi(zInputStr, 10);
+                        if (Value > 255)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error setting ramp"));
+                        }
+                        else
+                        {
+                            SetRampPeriods((unsigned char)Value);
+                        }
+                    }
+                    // Back to top menu
+                    MenuState = TOP_MENU;
+                    break;
+
+                case USER_READ_POINT:
+                    if (zInputStr[0] != '\0')
+                    {   // Another point. The rest keep their old values.
+                        Value = _atoi(zInputStr, 10);
+                        if (((int)Value < -100) || ((int)Value > 100))
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Point out of range"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Percent of the peak, about mid-scale
+                            SetUserWavePoint(UserPoint++, 0x8000 +
+                                             (int)(((long)(int)Value * 32767) / 100));
+                            if (UserPoint < USER_WAVE_SIZE)
+                            {   // Get the next point
+                                SCIWriteString_P(PSTR("\n\r  Enter user waveform point "));
+                                ptrOutputStr = zOutputStr;
+                                _itoa(&ptrOutputStr, UserPoint, 10);
+                                SCIWriteString(zOutputStr);
+                                SCIWriteString_P(PSTR(": "));
+                            }
+                            else
+                            {   // Have them all
+                                MenuState = TOP_MENU;
+                            }
+                        }
+                    }
+                    else
+                    {   // No more points
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case VOICE_READ_NUMBER:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        VoiceNumber = _atoi(zInputStr, 10);
+
+                        // Now get frequency
+                        SCIWriteString_P(PSTR("\n\r  Enter frequency (0 to "));
+                        WriteDecimal(MAX_VOICE_FREQUENCY, 0);
+                        SCIWriteString_P(PSTR("): "));
+                        MenuState = VOICE_READ_FREQUENCY;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case VOICE_READ_FREQUENCY:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        Frequency = _atoi(zInputStr, 10);
+
+                        // Now get level
+                        SCIWriteString_P(PSTR("\n\r  Enter level (0 to 100 %): "));
+                        MenuState = VOICE_READ_LEVEL;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case VOICE_READ_LEVEL:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        VoiceLevel = _atoi(zInputStr, 10);
+
+                        // Now get phase
+                        SCIWriteString_P(PSTR("\n\r  Enter phase (0 to 359 degrees): "));
+                        MenuState = VOICE_READ_PHASE;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case VOICE_READ_PHASE:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (SetVoice(VoiceNumber, Frequency, VoiceLevel,
+                                     _atoi(zInputStr, 10)) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error setting voice"));
+                        }
+                    }
+                    // Back to top menu
+                    MenuState = TOP_MENU;
+                    break;
+
+#if (D2A_CHANNELS > 1)
+                case CHANNEL_READ_NUMBER:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        ChannelNumber = _atoi(zInputStr, 10);
+
+                        // Now get frequency
+                        SCIWriteString_P(PSTR("\n\r  Enter frequency "));
+                        WriteFrequencyRange();
+                        MenuState = CHANNEL_READ_FREQUENCY;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case CHANNEL_READ_FREQUENCY:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadTenths(zInputStr, &Frequency) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid frequency"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get voltage
+                            SCIWriteString_P(PSTR("\n\r  Enter voltage (0 or 100 to 500): "));
+                            MenuState = CHANNEL_READ_VOLTAGE;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case CHANNEL_READ_VOLTAGE:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        Voltage = _atoi(zInputStr, 10);
+
+                        // Now get waveform
+                        SCIWriteString_P(PSTR("\n\r  Enter waveform (0=sine 1=square 2=triangle 3=saw 4=user): "));
+                        MenuState = CHANNEL_READ_WAVEFORM;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case CHANNEL_READ_WAVEFORM:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (SetChannel(ChannelNumber, Frequency, Voltage,
+                                       (eWaveformType)_atoi(zInputStr, 10)) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error setting channel"));
+                        }
+                    }
+                    // Back to top menu
+                    MenuState = TOP_MENU;
+                    break;
+#endif
+
+#if defined (D2A_CALIBRATION)
+                case CAL_READ_VIEW:
+                    // Back to top menu, unless there's a D/A to show
+                    MenuState = TOP_MENU;
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadSigned(zInputStr, 0, D2A_CHANNELS - 1,
+                                       &iValue) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid D/A channel"));
+                        }
+                        else
+                        {
+                            CalNumber = (unsigned char)iValue;
+                            MenuState = DISPLAY_CAL;
+                        }
+                    }
+                    break;
+
+                case CAL_READ_NUMBER:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadSigned(zInputStr, 0, D2A_CHANNELS - 1,
+                                       &iValue) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid D/A channel"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get offset
+                            CalNumber = (unsigned char)iValue;
+                            SCIWriteString_P(PSTR("\n\r  Enter offset error (LSB): "));
+                            MenuState = CAL_READ_OFFSET;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case CAL_READ_OFFSET:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadSigned(zInputStr, -D2A_CAL_MAX_OFFSET,
+                                       D2A_CAL_MAX_OFFSET, &iValue) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid offset error"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get gain error
+                            Cal.iOffset = iValue;
+                            SCIWriteString_P(PSTR("\n\r  Enter gain error (0.01%): "));
+                            MenuState = CAL_READ_GAIN;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case CAL_READ_GAIN:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadSigned(zInputStr, -D2A_CAL_MAX_GAIN_ERROR,
+                                       D2A_CAL_MAX_GAIN_ERROR, &iValue) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid gain error"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get the INL points
+                            Cal.iGainError = iValue;
+                            CalPoint = 0;
+                            SCIWriteString_P(PSTR("\n\r  Enter INL error at point 0 (LSB, Enter for none): "));
+                            MenuState = CAL_READ_INL;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case CAL_READ_INL:
+                    if (zInputStr[0] == '\0')
+                    {   // No more points. The rest have no error.
+                        while (CalPoint < D2A_CAL_POINTS)
+                        {
+                            Cal.scInl[CalPoint++] = 0;
+                        }
+                    }
+                    else if (ReadSigned(zInputStr, -128, 127, &iValue) == NO_ERROR)
+                    {   // Another point
+                        Cal.scInl[CalPoint++] = (signed char)iValue;
+                    }
+                    else
+                    {   // Doesn't fit in a byte. Ask for the same point again.
+                        SCIWriteString_P(PSTR("\n\r  Invalid INL error"));
+                    }
+
+                    if (CalPoint < D2A_CAL_POINTS)
+                    {   // Get the next point
+                        SCIWriteString_P(PSTR("\n\r  Enter INL error at point "));
+                        WriteDecimal(CalPoint, 0);
+                        SCIWriteString_P(PSTR(" (LSB): "));
+                    }
+                    else
+                    {   // Have them all
+                        if (SetCalibration(CalNumber, &Cal) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error setting calibration"));
+                        }
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+#endif
+
+                case SWEEP_READ_START:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadTenths(zInputStr, &SweepStart) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid frequency"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get stop frequency
+                            SCIWriteString_P(PSTR("\n\r  Enter stop frequency "));
+                            WriteFrequencyRange();
+                            MenuState = SWEEP_READ_STOP;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case SWEEP_READ_STOP:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (ReadTenths(zInputStr, &SweepStop) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Invalid frequency"));
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get duration
+                            SCIWriteString_P(PSTR("\n\r  Enter sweep time (1 to 3600 seconds): "));
+                            MenuState = SWEEP_READ_DURATION;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case SWEEP_READ_DURATION:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        SweepTime = _atoi(zInputStr, 10);
+
+                        // Now get sweep type
+                        SCIWriteString_P(PSTR("\n\r  Enter sweep type (0=linear 1=log): "));
+                        MenuState = SWEEP_READ_TYPE;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case SWEEP_READ_TYPE:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (StartSweep(SweepStart, SweepStop, SweepTime,
+                                       (eSweepType)_atoi(zInputStr, 10)) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error starting sweep"));
+                        }
+                    }
+                    // Back to top menu
+                    MenuState = TOP_MENU;
+                    break;
+
+                case MOD_READ_TYPE:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        ModType = _atoi(zInputStr, 10);
+
+                        if (ModType == MOD_NONE)
+                        {   // Nothing else needed
+                            SetModulation(MOD_NONE, 0, 0);
+                            MenuState = TOP_MENU;
+                        }
+                        else
+                        {   // Now get rate
+                            SCIWriteString_P(PSTR("\n\r  Enter rate (1 to 200 tenths of Hz): "));
+                            MenuState = MOD_READ_RATE;
+                        }
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case MOD_READ_RATE:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        ModRate = _atoi(zInputStr, 10);
+
+                        // Now get depth
+                        if (ModType == MOD_AM)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Enter depth (0 to 100 %): "));
+                        }
+                        else
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Enter deviation (0 to 40 Hz): "));
+                        }
+                        MenuState = MOD_READ_DEPTH;
+                    }
+                    else
+                    {   // No entry
+                        // Back to top menu
+                        MenuState = TOP_MENU;
+                    }
+                    break;
+
+                case MOD_READ_DEPTH:
+                    if (zInputStr[0] != '\0')
+                    {   // Just skip NULL entries
+                        if (SetModulation((eModulationType)ModType, ModRate,
+                                          _atoi(zInputStr, 10)) != NO_ERROR)
+                        {
+                            SCIWriteString_P(PSTR("\n\r  Error setting modulation"));
+                        }
+                    }
+                    // Back to top menu
+                    MenuState = TOP_MENU;
                     break;
 
 				case MEMORY_GET_ADDRESS:
@@ -460,20 +1183,392 @@ void RunMenu(void)
 	{	// Display 4th part of help menu
 		SCIWriteString_P(PSTR("  dsp - Display signal parameters\n\r"));
 		SCIWriteString_P(PSTR("  msp - Change desired signal parameters\n\r"));
+		SCIWriteString_P(PSTR("  ramp - Ramp amplitude changes over periods\n\r"));
 		MenuState = DISPLAY_HELP_MENU5;
 	}
 
 	else if (MenuState == DISPLAY_HELP_MENU5)
 	{	// Display 5th part of help menu
-		SCIWriteString_P(PSTR("  ds  - Display A/D samples \n\r"));
-		SCIWriteString_P(PSTR("  rm  - Read memory\n\r"));
+		SCIWriteString_P(PSTR("  wf  - Select output waveform\n\r"));
+		SCIWriteString_P(PSTR("  uw  - Load user waveform\n\r"));
+		SCIWriteString_P(PSTR("  mv  - Change mixed voice\n\r"));
+		SCIWriteString_P(PSTR("  sw  - Sweep frequency\n\r"));
+		SCIWriteString_P(PSTR("  mod - Modulate output (AM or FM)\n\r"));
+#if (D2A_CHANNELS > 1)
+		SCIWriteString_P(PSTR("  ch  - Change extra D/A channel\n\r"));
+#endif
 		MenuState = DISPLAY_HELP_MENU6;
 	}
 
 	else if (MenuState == DISPLAY_HELP_MENU6)
 	{	// Display 6th part of help menu
+		SCIWriteString_P(PSTR("  ds  - Display A/D samples \n\r"));
+		SCIWriteString_P(PSTR("  rm  - Read memory\n\r"));
+		MenuState = DISPLAY_HELP_MENU7;
+	}
+
+	else if (MenuState == DISPLAY_HELP_MENU7)
+	{	// Display 7th part of help menu
 		SCIWriteString_P(PSTR("  wm  - Write memory\r"));
+#if defined (SIGNAL_CAPTURE)
+		SCIWriteString_P(PSTR("  cap - Capture output; dcap - dump it\n\r"));
+#endif
+#if defined (D2A_CALIBRATION)
+		SCIWriteString_P(PSTR("  cal - Show D/A calibration; ldcal - load it\n\r"));
+#endif
+#if defined (TASK_PROFILE)
+		SCIWriteString_P(PSTR("  prof - Show execution times; cprof - clear them\n\r"));
+#endif
+#if defined (SAMPLE_JITTER)
+		SCIWriteString_P(PSTR("  jit - Show sample latency; cjit - clear it\n\r"));
+#endif
 		SCIWriteString_P(PSTR("  ?   - Display this help menu\n\r"));
 		MenuState = TOP_MENU;
 	}
+
+	else if (MenuState == DISPLAY_SIGNAL2)
+	{	// Display actual signal parameters
+		SCIWriteString_P(PSTR("  Actual Frequency = "));
+		WriteDecimal(GET_FREQ_ACTUAL(), 2);
+		SCIWriteString_P(PSTR(" Hz\n\r"));
+
+		SCIWriteString_P(PSTR("  Actual Voltage = "));
+		ptrOutputStr = zOutputStr;
+		_itoa(&ptrOutputStr, GET_VOLT_ACTUAL(), 10);
+		SCIWriteString(zOutputStr);
+		SCIWriteString_P(PSTR("\n\r"));
+		MenuState = DISPLAY_SIGNAL3;
+	}
+
+	else if (MenuState == DISPLAY_SIGNAL3)
+	{	// Display sample rate plan for this frequency
+		GetSignalPlan(&Plan);
+		SCIWriteString_P(PSTR("  Sample Rate = "));
+		WriteDecimal(Plan.ulSampleRate, 0);
+		SCIWriteString_P(PSTR(" Hz\n\r  Timer 1 Prescaler = "));
+		WriteDecimal(Plan.uiPrescaler, 0);
+		SCIWriteString_P(PSTR("\n\r"));
+		MenuState = DISPLAY_SIGNAL4;
+	}
+
+	else if (MenuState == DISPLAY_SIGNAL4)
+	{
+		GetSignalPlan(&Plan);
+		SCIWriteString_P(PSTR("  Timer 1 OCR1A = "));
+		WriteDecimal(Plan.uiTimerCount, 0);
+		SCIWriteString_P(PSTR(" + "));
+		WriteDecimal(Plan.uiTimerFrac, 0);
+		SCIWriteString_P(PSTR("/65536\n\r  Samples per Period = "));
+		WriteDecimal(Plan.ulSamplesPerPeriod, 0);
+		SCIWriteString_P(PSTR("\n\r"));
+		MenuState = DISPLAY_SIGNAL5;
+	}
+
+	else if (MenuState == DISPLAY_SIGNAL5)
+	{
+		SCIWriteString_P(PSTR("  Waveform = "));
+		WriteDecimal(GET_WAVEFORM(), 0);
+		SCIWriteString_P(PSTR("\n\r  Sweep Progress = "));
+		WriteDecimal(GetSweepProgress(), 0);
+		SCIWriteString_P(PSTR(" %\n\r"));
+		MenuState = DISPLAY_SIGNAL6;
+	}
+
+	else if (MenuState == DISPLAY_SIGNAL6)
+	{	// Display output errors
+		GetDtoAStats(&D2AStats);
+		SCIWriteString_P(PSTR("  Sample Underruns = "));
+		WriteDecimal(GetSampleUnderruns(), 0);
+		SCIWriteString_P(PSTR("\n\r  D/A Frames Dropped = "));
+		WriteDecimal(D2AStats.uiFramesInFlight, 0);
+		SCIWriteString_P(PSTR("\n\r"));
+		MenuState = DISPLAY_SIGNAL7;
+	}
+
+	else if (MenuState == DISPLAY_SIGNAL7)
+	{
+		GetDtoAStats(&D2AStats);
+		SCIWriteString_P(PSTR("  D/A Write Collisions = "));
+		WriteDecimal(D2AStats.uiWriteCollisions, 0);
+		SCIWriteString_P(PSTR("\n\r  D/A Mode Faults = "));
+		WriteDecimal(D2AStats.uiModeFaults, 0);
+		SCIWriteString_P(PSTR("\n\r"));
+#if (D2A_CHANNELS > 1)
+		MenuState = DISPLAY_SIGNAL8;
+#else
+		MenuState = TOP_MENU;
+#endif
+	}
+
+#if (D2A_CHANNELS > 1)
+	else if (MenuState == DISPLAY_SIGNAL8)
+	{	// Display timing of the last D/A burst, in CPU clocks
+		GetDtoAStats(&D2AStats);
+		GetSignalPlan(&Plan);
+		SCIWriteString_P(PSTR("  D/A Burst Time = "));
+		WriteDecimal((unsigned long)D2AStats.uiBurstTime * Plan.uiPrescaler, 0);
+		SCIWriteString_P(PSTR(" clocks\n\r  D/A Skew ="));
+		for (i = 1; i < D2A_CHANNELS; i++)
+		{
+			SCIWriteString_P(PSTR(" "));
+			WriteDecimal((unsigned long)D2AStats.uiChannelSkew[i] * Plan.uiPrescaler, 0);
+		}
+		SCIWriteString_P(PSTR(" clocks\n\r"));
+		MenuState = TOP_MENU;
+	}
+#endif
+
+#if defined (D2A_CALIBRATION)
+	else if (MenuState == DISPLAY_CAL)
+	{	// Display the calibration of one D/A
+		GetCalibration(CalNumber, &Cal);
+		SCIWriteString_P(PSTR("  Offset Error = "));
+		WriteSigned(Cal.iOffset, 0);
+		SCIWriteString_P(PSTR(" LSB\n\r  Gain Error = "));
+		WriteSigned(Cal.iGainError, 2);
+		SCIWriteString_P(PSTR(" %\n\r  INL Error ="));
+		for (i = 0; i < D2A_CAL_POINTS; i++)
+		{
+			SCIWriteString_P(PSTR(" "));
+			WriteSigned(Cal.scInl[i], 0);
+		}
+		SCIWriteString_P(PSTR(" LSB\n\r"));
+		MenuState = TOP_MENU;
+	}
+#endif
+
+#if defined (TASK_PROFILE)
+	else if (MenuState == DISPLAY_PROFILE)
+	{	// Display the times of one profiled task
+		ProfileType Profile;
+
+		GetProfile(ProfileIndex, &Profile);
+		SCIWriteString_P(PSTR("  "));
+		SCIWriteString_P(ProfileNames[ProfileIndex]);
+		SCIWriteString_P(PSTR(" "));
+		WriteDecimal(Profile.ulRuns, 0);
+		if (Profile.ulRuns != 0)
+		{
+			SCIWriteString_P(PSTR(" "));
+			WriteDecimal(Profile.uiMin, 0);
+			SCIWriteString_P(PSTR(" "));
+			WriteDecimal(Profile.uiMax, 0);
+			SCIWriteString_P(PSTR(" "));
+			WriteDecimal(Profile.ulSum / Profile.ulSumRuns, 0);
+		}
+		SCIWriteString_P(PSTR("\n\r"));
+
+		if (++ProfileIndex == NUM_PROFILES)
+		{
+			MenuState = TOP_MENU;
+		}
+	}
+#endif
+
+#if defined (SAMPLE_JITTER)
+	else if (MenuState == DISPLAY_JITTER)
+	{	// Display the next few bins, as "first count: samples"
+		for (i = 0; (i < JITTER_PER_PASS) && (JitterIndex < JITTER_BINS); i++)
+		{
+			SCIWriteString_P(PSTR("  "));
+			WriteDecimal((unsigned int)JitterIndex * JITTER_BIN_COUNTS, 0);
+			if (JitterIndex == JITTER_BINS - 1)
+			{
+				SCIWriteString_P(PSTR("+"));
+			}
+			SCIWriteString_P(PSTR(": "));
+			WriteDecimal(JitterBins[JitterIndex++], 0);
+			SCIWriteString_P(PSTR("\n\r"));
+		}
+
+		if (JitterIndex == JITTER_BINS)
+		{
+			MenuState = TOP_MENU;
+		}
+	}
+#endif
+
+#if defined (SIGNAL_CAPTURE)
+	else if (MenuState == DISPLAY_CAPTURE)
+	{	// Send the next few captured D/A codes, one per line
+		for (i = 0; (i < CAPTURE_PER_PASS) && (CaptureIndex < CAPTURE_SIZE); i++)
+		{
+			WriteDecimal(pCapture[CaptureIndex++], 0);
+			SCIWriteString_P(PSTR("\n\r"));
+		}
+
+		if (CaptureIndex == CAPTURE_SIZE)
+		{
+			SCIWriteString_P(PSTR("end\n\rcmd> "));
+			MenuState = TOP_MENU;
+		}
+	}
+#endif
+
+	PROFILE_EXIT(PROFILE_MENU);
+}
+
+/******************************************************************************
+ * Converts a decimal string with up to one digit after the point, such as
+ * "12.5", to tenths. Any more digits after the point are ignored. Returns
+ * PARAMETER_OUT_OF_RANGE, and leaves *puiTenths alone, if the string holds
+ * anything but digits and one point, or the value doesn't fit in 16 bits.
+ ******************************************************************************/
+static eErrorType ReadTenths(char *pStr, unsigned int *puiTenths)
+{
+    eErrorType ReturnVal = NO_ERROR;
+    unsigned long ulValue = 0;
+    unsigned char bPoint = FALSE, bFraction = FALSE;
+
+    while ((*pStr != '\0') && (ReturnVal == NO_ERROR))
+    {
+        if ((*pStr == '.') && !bPoint)
+        {
+            bPoint = TRUE;
+        }
+        else if ((*pStr < '0') || (*pStr > '9'))
+        {   // Not a number
+            ReturnVal = PARAMETER_OUT_OF_RANGE;
+        }
+        else if (!bPoint)
+        {   // Whole part. Checked as it goes, so it can't wrap.
+            ulValue = (ulValue * 10) + (*pStr - '0');
+            if (ulValue > 0xFFFFUL / 10)
+            {
+                ReturnVal = PARAMETER_OUT_OF_RANGE;
+            }
+        }
+        else if (!bFraction)
+        {   // First digit after the point
+            ulValue = (ulValue * 10) + (*pStr - '0');
+            bFraction = TRUE;
+        }
+        pStr++;
+    }
+
+    if (!bFraction)
+    {   // No tenths given
+        ulValue *= 10;
+    }
+
+    if ((ReturnVal == NO_ERROR) && (ulValue > 0xFFFFUL))
+    {   // 6553.6 and up
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+
+    if (ReturnVal == NO_ERROR)
+    {
+        *puiTenths = (unsigned int)ulValue;
+    }
+
+    return ReturnVal;
+}
+
+/******************************************************************************
+ * Writes the range of the main signal's frequency, for the prompts.
+ ******************************************************************************/
+static void WriteFrequencyRange(void)
+{
+    SCIWriteString_P(PSTR("("));
+    WriteDecimal(MIN_FREQUENCY, 1);
+    SCIWriteString_P(PSTR(" to "));
+    WriteDecimal(MAX_FREQUENCY, 1);
+    SCIWriteString_P(PSTR("): "));
+}
+
+/******************************************************************************
+ * Writes an unsigned fixed-point value to the serial port, with ucPlaces
+ * digits after the decimal point.
+ ******************************************************************************/
+static void WriteDecimal(unsigned long ulValue, unsigned char ucPlaces)
+{
+    char zStr[STRLEN + 1];
+    char *pStr = &zStr[STRLEN];
+    unsigned char i;
+
+    // Build the string backwards, from the last digit
+    *pStr = '\0';
+    for (i = 0; (ulValue != 0) || (i <= ucPlaces); i++)
+    {
+        if ((i == ucPlaces) && (i != 0))
+        {
+            *--pStr = '.';
+        }
+        *--pStr = (char)(ulValue % 10) + '0';
+        ulValue /= 10;
+    }
+
+    SCIWriteString(pStr);
+}
+
+#if defined (D2A_CALIBRATION)
+/******************************************************************************
+ * Converts a decimal string, with an optional leading '-', to an int.
+ * Returns PARAMETER_OUT_OF_RANGE, and leaves *piValue alone, if the string
+ * holds anything but digits or the value is outside iMin to iMax.
+ ******************************************************************************/
+static eErrorType ReadSigned(char *pStr, int iMin, int iMax, int *piValue)
+{
+    eErrorType ReturnVal = NO_ERROR;
+    long lValue = 0;
+    unsigned char bNegative = FALSE;
+
+    if (*pStr == '-')
+    {
+        bNegative = TRUE;
+        pStr++;
+    }
+
+    if (*pStr == '\0')
+    {   // No digits
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+
+    while ((*pStr != '\0') && (ReturnVal == NO_ERROR))
+    {
+        if ((*pStr < '0') || (*pStr > '9'))
+        {   // Not a number
+            ReturnVal = PARAMETER_OUT_OF_RANGE;
+        }
+        else
+        {   // Checked as it goes, so it can't wrap
+            lValue = (lValue * 10) + (*pStr - '0');
+            if (lValue > 0x8000L)
+            {
+                ReturnVal = PARAMETER_OUT_OF_RANGE;
+            }
+        }
+        pStr++;
+    }
+
+    if (bNegative)
+    {
+        lValue = -lValue;
+    }
+
+    if ((ReturnVal == NO_ERROR) && ((lValue < iMin) || (lValue > iMax)))
+    {
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+
+    if (ReturnVal == NO_ERROR)
+    {
+        *piValue = (int)lValue;
+    }
+
+    return ReturnVal;
+}
+
+/******************************************************************************
+ * Writes a signed fixed-point value to the serial port, as WriteDecimal.
+ ******************************************************************************/
+static void WriteSigned(int iValue, unsigned char ucPlaces)
+{
+    if (iValue < 0)
+    {
+        SCIWriteString_P(PSTR("-"));
+        iValue = -iValue;
+    }
+    WriteDecimal((unsigned int)iValue, ucPlaces);
 }
+#endif
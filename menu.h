@@ -7,11 +7,13 @@
  *  Date	Changed by:	Changes:
  * -------	-----------	-------------------------------------------------------
  * 13Aug02	R Weber		Original file.
+ * 16Oct26	agent		Added InitMenu.
  ******************************************************************************/
 #if !defined(MENU_H)		/* Prevents including this file multiple times */
 #define MENU_H
 
 /* Function Prototypes */
+void InitMenu(void);
 void RunMenu(void);
 
 #endif /* MENU_H */
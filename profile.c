@@ -0,0 +1,100 @@
+/******************************************************************************
+ * File Name:	profile.c
+ * Program:		Project for Real-Time Embedded Systems Programming class
+ * Author:		agent
+ * Purpose:		Keeps execution-time statistics for the interrupts and tasks
+ *				marked with PROFILE_ENTER and PROFILE_EXIT.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "lib.h"
+#include "profile.h"
+
+#if defined (TASK_PROFILE)
+
+static ProfileType Profiles[NUM_PROFILES];
+
+/******************************************************************************
+ * Starts Timer 5 free-running at F_CPU, and clears the table.
+ ******************************************************************************/
+void InitProfile(void)
+{
+	/* Normal mode, no prescaling */
+	TCCR5A = 0;
+	TCCR5B = _BV(CS50);
+
+#if defined (PROFILE_PULSE)
+	SET_BIT(DDRB, TIMING_BIT);
+	CLEAR_BIT(PORTB, TIMING_BIT);
+#endif
+
+	ClearProfile();
+}
+
+/******************************************************************************
+ * Adds one run of a piece of code, which took uiClocks, to the table. This
+ * is called from interrupts, so it's kept short.
+ ******************************************************************************/
+void ProfileRecord(eProfileType Id, unsigned int uiClocks)
+{
+	ProfileType *pProfile = &Profiles[Id];
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (uiClocks < pProfile->uiMin)
+		{
+			pProfile->uiMin = uiClocks;
+		}
+		if (uiClocks > pProfile->uiMax)
+		{
+			pProfile->uiMax = uiClocks;
+		}
+		++pProfile->ulRuns;
+
+		if ((pProfile->ulSum & 0x80000000UL) != 0)
+		{	// Keep the mean, but make room in the sum
+			pProfile->ulSum >>= 1;
+			pProfile->ulSumRuns >>= 1;
+		}
+		pProfile->ulSum += uiClocks;
+		++pProfile->ulSumRuns;
+	}
+}
+
+/******************************************************************************
+ * Returns the timings of one piece of code.
+ ******************************************************************************/
+void GetProfile(eProfileType Id, ProfileType *pProfile)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*pProfile = Profiles[Id];
+	}
+}
+
+/******************************************************************************
+ * Forgets all timings.
+ ******************************************************************************/
+void ClearProfile(void)
+{
+	unsigned char i;
+
+	for (i = 0; i < NUM_PROFILES; i++)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			Profiles[i].uiMin = 0xFFFF;
+			Profiles[i].uiMax = 0;
+			Profiles[i].ulRuns = 0;
+			Profiles[i].ulSum = 0;
+			Profiles[i].ulSumRuns = 0;
+		}
+	}
+}
+
+#endif /* TASK_PROFILE */
@@ -0,0 +1,80 @@
+/******************************************************************************
+ * File Name:	profile.h
+ * Program:		Project for Real-Time Embedded Systems Programming class
+ * Author:		agent
+ * Purpose:		Header file for profile.c file. Execution-time profiling of
+ *				the interrupts and tasks.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#if !defined(PROFILE_H)		/* Prevents including this file multiple times */
+#define PROFILE_H
+
+#include <avr/io.h>
+
+#include "lib.h"
+
+/* Code that's profiled. Each has a line in the profile table. */
+typedef enum {
+	PROFILE_TIMER0,			/* Medium-thread ISR, including its tasks */
+	PROFILE_TIMER1,			/* Sample ISR */
+	PROFILE_SPI,			/* D/A byte-sent ISR */
+	PROFILE_SCI_RX,			/* Serial receive ISR */
+	PROFILE_SCI_TX,			/* Serial transmit ISR */
+	PROFILE_HEARTBEAT,
+	PROFILE_MENU,
+	PROFILE_SIGNAL,			/* UpdateSignal */
+	PROFILE_RENDER,			/* One block rendered by ServiceSignal */
+	NUM_PROFILES
+} eProfileType;
+
+/* With TASK_PROFILE, PROFILE_ENTER and PROFILE_EXIT bracket each piece of
+ * code in the table. Times are in CPU clocks from Timer 5, which free-runs
+ * at F_CPU, so one run can be timed up to 65535 clocks. They include any
+ * interrupts taken meanwhile. PROFILE_PULSE can be set to one of the
+ * eProfileType names, and TIMING_BIT is then high while that code runs,
+ * for a scope. Without TASK_PROFILE the macros are empty, so they cost
+ * nothing. */
+#if defined (TASK_PROFILE)
+
+/* Timings of one piece of code, in clocks. The sum and its count are
+ * halved together before the sum can overflow, so they still give the
+ * mean. */
+typedef struct
+{
+	unsigned int uiMin;
+	unsigned int uiMax;
+	unsigned long ulRuns;
+	unsigned long ulSum;
+	unsigned long ulSumRuns;
+} ProfileType;
+
+#if defined (PROFILE_PULSE)
+#define PROFILE_PULSE_ON(Id)	if ((Id) == PROFILE_PULSE)					\
+									SET_BIT(PORTB, TIMING_BIT)
+#define PROFILE_PULSE_OFF(Id)	if ((Id) == PROFILE_PULSE)					\
+									CLEAR_BIT(PORTB, TIMING_BIT)
+#else
+#define PROFILE_PULSE_ON(Id)
+#define PROFILE_PULSE_OFF(Id)
+#endif
+
+#define PROFILE_ENTER(Id)		unsigned int uiProfileStart_##Id = TCNT5;		\
+								PROFILE_PULSE_ON(Id)
+#define PROFILE_EXIT(Id)		PROFILE_PULSE_OFF(Id);							\
+								ProfileRecord(Id, TCNT5 - uiProfileStart_##Id)
+
+/* Function Prototypes */
+void InitProfile(void);
+void ProfileRecord(eProfileType, unsigned int);
+void GetProfile(eProfileType, ProfileType *);
+void ClearProfile(void);
+
+#else
+#define PROFILE_ENTER(Id)
+#define PROFILE_EXIT(Id)
+#endif /* TASK_PROFILE */
+
+#endif /* PROFILE_H */
@@ -17,6 +17,9 @@
  * 18 May 08	T Lill		Removed dummy variable from initialization functions.
  *							Replaced OSC_FREQ with F_CPU.
  * 01 Nov 10	T Lill		Converted program to ATmega2560
+ * 16 Oct 26	agent		Rx ISR posts EVENT_RX_LINE at the end of a line.
+ *							Added profiling. Buffers use byte indexes, which
+ *							can't be read half written.
  ******************************************************************************/
 #include <avr/io.h>
 #include <avr/interrupt.h>
@@ -24,6 +27,8 @@
 #include "lib.h"
 #include "serial.h"
 #include "errors.h"
+#include "profile.h"
+#include "events.h"
 
 // Calculate Baud Rate values. Note that UBRR_VALUE should be < 4095. 
 // No check is made to verify this.
@@ -32,22 +37,30 @@
 #define UART_CLOCK_DIVIDER	16
 #define UBRR_VALUE 		(((F_CPU/UART_CLOCK_DIVIDER)/BAUD_RATE) - 1)
 
-/* Macros for moving character buffer pointers */
-#define INC_CIRC_BUFFER_PTR(ptr, Addr, Length)	            \
-    ((ptr >= Addr + Length - 1) ? Addr : ptr+1)
+/* Macro for moving character buffer indexes */
+#define INC_CIRC_BUFFER_INDEX(Index, Length)	            \
+    ((Index >= Length - 1) ? 0 : Index + 1)
+
+/* The buffers are indexed with bytes, which the AVR reads and writes in one
+ * go. Each index is written by one side and read by the other, and the menu
+ * and the ISRs run at the same time, so a 16-bit pointer could be read half
+ * updated. */
+#if (MAX_OUT_STR_SIZE > 256) || (MAX_IN_STR_SIZE > 256)
+#error "Serial buffers must be 256 characters or less"
+#endif
 
 /*
- * Define output string variables.  The Head and Tail pointers - but not the
- * data being pointed to - need to be volatile.
+ * Define output string variables.  The Head and Tail indexes - but not the
+ * data being indexed - need to be volatile.
  */
 static char zOutputChars[MAX_OUT_STR_SIZE];
-static char * volatile ptrOutputCharHead;		
-static char * volatile ptrOutputCharTail;
+static volatile unsigned char ucOutputCharHead;
+static volatile unsigned char ucOutputCharTail;
 
 /* Define input string variables */
 static char zInputChars[MAX_IN_STR_SIZE];
-static char * volatile ptrInputCharHead;
-static char * volatile ptrInputCharTail;
+static volatile unsigned char ucInputCharHead;
+static volatile unsigned char ucInputCharTail;
 
 /******************************************************************************
  * Initialize the SCI interface.
@@ -95,14 +108,14 @@ void SCIInitialize(void)
 	 */
 	UCSR0A = 0;
 
-   /* Initialize the pointers to the character buffers. New characters to be
-     * received or transmitted are  added using the Head pointer. When characters
+   /* Initialize the indexes to the character buffers. New characters to be
+     * received or transmitted are  added using the Head index. When characters
      * retrieved by an outside program or transmitted by the transmitter, they're
-     * removed from the buffers using the Tail pointer. */
-    ptrInputCharHead    = zInputChars;
-    ptrInputCharTail    = zInputChars;
-    ptrOutputCharHead   = zOutputChars;
-    ptrOutputCharTail   = zOutputChars;
+     * removed from the buffers using the Tail index. */
+    ucInputCharHead     = 0;
+    ucInputCharTail     = 0;
+    ucOutputCharHead    = 0;
+    ucOutputCharTail    = 0;
 
     // Display start-up greeting
     SCIWriteString_P(PSTR("Welcome to Embedded Systems Programming\n\r"));
@@ -118,28 +131,37 @@ void SCIInitialize(void)
 ISR(USART0_UDRE_vect)
 {
 	char TxData;
+	unsigned char ucTail = ucOutputCharTail;
+	PROFILE_ENTER(PROFILE_SCI_TX);
 	    
 	// Disable UDR interrupt, and enable global interrupts
 	CLEAR_BIT(UCSR0B, UDRIE0);
 	sei();
 
-	// Save value to transmit, so we can send it later in the ISR.
-	TxData = *ptrOutputCharTail;
-
-	/* Move pointer to next character */            
-	ptrOutputCharTail = INC_CIRC_BUFFER_PTR(ptrOutputCharTail, 
-						zOutputChars, MAX_OUT_STR_SIZE);
-
-	// Send next character. We do this as close to the end of the ISR as
-	// possible.
-    UDR0 = TxData;
-
-	/* Check to see if we've just transmitted the last character.
-	 * If not, enable the interrupt. */
-	if (ptrOutputCharTail != ptrOutputCharHead)        
+	/* The writer sets UDRIE0 with a read-modify-write, which can put it back
+	 * just after the last character went. Then there's nothing to send. */
+	if (ucTail != ucOutputCharHead)
 	{
-		SET_BIT(UCSR0B, UDRIE0);
+		// Save value to transmit, so we can send it later in the ISR.
+		TxData = zOutputChars[ucTail];
+
+		/* Move index to next character */
+		ucTail = INC_CIRC_BUFFER_INDEX(ucTail, MAX_OUT_STR_SIZE);
+		ucOutputCharTail = ucTail;
+
+		// Send next character. We do this as close to the end of the ISR as
+		// possible.
+		UDR0 = TxData;
+
+		/* Check to see if we've just transmitted the last character.
+		 * If not, enable the interrupt. */
+		if (ucTail != ucOutputCharHead)
+		{
+			SET_BIT(UCSR0B, UDRIE0);
+		}
 	}
+
+	PROFILE_EXIT(PROFILE_SCI_TX);
 }
 
 /*****************************************************************************
@@ -148,28 +170,35 @@ ISR(USART0_UDRE_vect)
 ISR(USART0_RX_vect)
 {
 	unsigned char status;
-	char *ptrPrev;
+	char RxData;
+	unsigned char ucNext;
+	PROFILE_ENTER(PROFILE_SCI_RX);
    
 	/* must do this first, since reading UDR0 resets the error flags */
 	status = UCSR0A;
    
 	/* Append character to input string */
-	*ptrInputCharHead = UDR0;
-
-   /* Move pointer to next character */
-	ptrPrev = ptrInputCharHead;
-	ptrInputCharHead = INC_CIRC_BUFFER_PTR(ptrInputCharHead, zInputChars, 
-										   MAX_IN_STR_SIZE);
+	RxData = UDR0;
+	zInputChars[ucInputCharHead] = RxData;
 
 	/* Check for receive buffer overflow */
-	if (ptrInputCharHead == ptrInputCharTail)
-	{  /* Buffer is full. By incrementing the pointer, it actually looks
-		* empty. So, decrement by 1, throwing away last received character,
-		* and record the problem.
+	ucNext = INC_CIRC_BUFFER_INDEX(ucInputCharHead, MAX_IN_STR_SIZE);
+	if (ucNext == ucInputCharTail)
+	{  /* Buffer is full. Moving the index on would make it look empty. So
+		* leave it, throwing away last received character, and record the
+		* problem.
 		*/
-		ptrInputCharHead = ptrPrev;
 		ReportError(SCI_RX_BUFFER_OVERFLOW);
 	}
+	else
+	{	/* Move index to next character */
+		ucInputCharHead = ucNext;
+
+		if (RxData == '\r')
+		{	// Have the menu deal with the line now, not on its next tick
+			PostEvent(EVENT_RX_LINE);
+		}
+	}
 
 	/* Check for input character errors */
    
@@ -187,6 +216,8 @@ ISR(USART0_RX_vect)
 	{
 		ReportError(SCI_RX_PARITY);
 	}
+
+	PROFILE_EXIT(PROFILE_SCI_RX);
 }
 
 /******************************************************************************
@@ -198,20 +229,18 @@ int SCIWriteString(char *Str)
     eBooleanType bCopyComplete = FALSE;
 
     /* Check to see if transmit buffer is full */
-    while ((INC_CIRC_BUFFER_PTR(ptrOutputCharHead, 
-			    				zOutputChars,
-				    			MAX_OUT_STR_SIZE) != ptrOutputCharTail) &&
+    while ((INC_CIRC_BUFFER_INDEX(ucOutputCharHead,
+				    			  MAX_OUT_STR_SIZE) != ucOutputCharTail) &&
            (bCopyComplete == FALSE))
 
 	{   /* Copy string to transmit to the output buffer */
         if (*Str != '\0')
         {
-            *ptrOutputCharHead = *Str;
+            zOutputChars[ucOutputCharHead] = *Str;
  
-            /* Move pointer to next character */
-  		    ptrOutputCharHead = INC_CIRC_BUFFER_PTR(ptrOutputCharHead, 
-			    								    zOutputChars,
-				    							    MAX_OUT_STR_SIZE);
+            /* Move index to next character */
+  		    ucOutputCharHead = INC_CIRC_BUFFER_INDEX(ucOutputCharHead,
+				    							     MAX_OUT_STR_SIZE);
             ++Str;
         }
         else
@@ -246,21 +275,19 @@ int SCIWriteString_P(PGM_P Str_P)
 	char Char_P;
 	
     /* Check to see if transmit buffer is full */
-    while ((INC_CIRC_BUFFER_PTR(ptrOutputCharHead, 
-			    				zOutputChars,
-				    			MAX_OUT_STR_SIZE) != ptrOutputCharTail) &&
+    while ((INC_CIRC_BUFFER_INDEX(ucOutputCharHead,
+				    			  MAX_OUT_STR_SIZE) != ucOutputCharTail) &&
            (bCopyComplete == FALSE))
 
 	{   /* Copy string to transmit to the output buffer */
 		Char_P = pgm_read_byte(Str_P);
         if (Char_P != '\0')
         {
-            *ptrOutputCharHead = Char_P;
+            zOutputChars[ucOutputCharHead] = Char_P;
  
-            /* Move pointer to next character */
-  		    ptrOutputCharHead = INC_CIRC_BUFFER_PTR(ptrOutputCharHead, 
-			    								    zOutputChars,
-				    							    MAX_OUT_STR_SIZE);
+            /* Move index to next character */
+  		    ucOutputCharHead = INC_CIRC_BUFFER_INDEX(ucOutputCharHead,
+				    							     MAX_OUT_STR_SIZE);
             ++Str_P;
         }
         else
@@ -294,14 +321,13 @@ char SCIReadChar(void)
 {
    char cReturnVal;
 
-   if (ptrInputCharHead != ptrInputCharTail)
+   if (ucInputCharHead != ucInputCharTail)
    {   /* Receive buffer is not empty */
-      cReturnVal = *ptrInputCharTail;
+      cReturnVal = zInputChars[ucInputCharTail];
 
-      /* Move pointer to next character */
-		ptrInputCharTail = INC_CIRC_BUFFER_PTR(ptrInputCharTail, 
-											   zInputChars,
-											   MAX_IN_STR_SIZE);
+      /* Move index to next character */
+		ucInputCharTail = INC_CIRC_BUFFER_INDEX(ucInputCharTail,
+												MAX_IN_STR_SIZE);
    }
    else
    {
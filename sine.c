@@ -7,14 +7,23 @@
  *  Date	Changed by:	Changes:
  * -------	-----------	-------------------------------------------------------
  * 30Apr02	R Weber		Initial file
+ * 16Oct26	agent		DDS renderer feeding a FIFO, with the sample rate
+ *						planned for each frequency. Added voices, sweeps,
+ *						modulation, waveforms, extra channels, calibration and
+ *						dither.
  ******************************************************************************/
 
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
 #include "sine.h"
 #include "lib.h"
 #include "dtoa.h"
 #include "interrpt.h"
+#include "profile.h"
 #if defined (SLOW_SINE)
 #include "serial.h"
+#include "events.h"
 #endif
 
 #if defined(DEBUG_D2A)
@@ -25,48 +34,487 @@
 #define MIN_VOLTAGE            100  // 1.0 Volts
 #define VOLTAGE_INCREMENT       10  // 0.1 Volt increments
 
-#define MAX_FREQUENCY          100  // 100 Hz
-#define MIN_FREQUENCY           40  //  40 Hz
-#define FREQUENCY_INCREMENT      5  //   5 Hz increments
+#define FREQUENCY_INCREMENT      1  //   0.1 Hz increments
 
 /* Define constants */
 #define VOLTAGE_1V_SCALE		100			/* = 1V */
 #define VOLTAGE_10THV_SCALE		 10			/* = 1/10 V */
 #define VOLTAGE_HALFV_SCALE		 50			/* = 1/2 V */
 
-// # of samples in the lookup tables
-#define SAMPLE_TABLE_SIZE		(SAMPLES_PER_PERIOD/2 + 1)
+/* Voltage that uses the full D/A range */
+#define VOLTAGE_FULL_SCALE     500  // 5.0 Volts
+
+/* # of samples in the quarter-wave lookup table. The table index is taken
+ * straight from the phase bits, so the table must be a power of two in size.
+ * The size is spelled out so it can be used to pick the table generator. */
+#if (SAMPLES_PER_PERIOD == 64)
+#define QUARTER_TABLE_SIZE		16
+#define QUARTER_TABLE_BITS		4
+#elif (SAMPLES_PER_PERIOD == 128)
+#define QUARTER_TABLE_SIZE		32
+#define QUARTER_TABLE_BITS		5
+#elif (SAMPLES_PER_PERIOD == 256)
+#define QUARTER_TABLE_SIZE		64
+#define QUARTER_TABLE_BITS		6
+#elif (SAMPLES_PER_PERIOD == 512)
+#define QUARTER_TABLE_SIZE		128
+#define QUARTER_TABLE_BITS		7
+#elif (SAMPLES_PER_PERIOD == 1024)
+#define QUARTER_TABLE_SIZE		256
+#define QUARTER_TABLE_BITS		8
+#elif (SAMPLES_PER_PERIOD == 2048)
+#define QUARTER_TABLE_SIZE		512
+#define QUARTER_TABLE_BITS		9
+#elif (SAMPLES_PER_PERIOD == 4096)
+#define QUARTER_TABLE_SIZE		1024
+#define QUARTER_TABLE_BITS		10
+#else
+#error "SAMPLES_PER_PERIOD must be a power of two from 64 to 4096"
+#endif
+
+/* Peak value held in the sine table. The table is added to or subtracted
+ * from mid-scale of a 16-bit unsigned value, so it can't exceed 32767. */
+#define SINE_TABLE_PEAK			32767
+
+/* The upper 16 bits of the phase accumulator are split into the quadrant
+ * (top 2 bits), the quarter-wave table index, and the remaining fraction. */
+#define PHASE_INDEX_SHIFT		(16 - 2 - QUARTER_TABLE_BITS)
+
+/* Size of the FIFO between the foreground, which renders samples, and the
+ * sample ISR. It must be a power of two. Samples are rendered once at least
+ * SAMPLE_BLOCK_SIZE entries are free. */
+#define SAMPLE_FIFO_SIZE		32
+#define SAMPLE_BLOCK_SIZE		8
+
+/* Samples in the FIFO are D/A codes or, with D2A_PREENCODE, the SPI frame
+ * for the code without its command bits, which are constant and are OR'd in
+ * by the ISR. The frame is only the code shifted up, so the renderer makes
+ * it for nothing by shifting the scaled sample that much less. The bits
+ * below the code are ignored by the D/A. */
+#if defined (D2A_PREENCODE)
+#define FIFO_SHIFT				D2A_FRAME_SHIFT
+#define FIFO_FRAME(Entry)		((Entry) | D2A_FRAME_COMMAND)
+#else
+#define FIFO_SHIFT				0
+#define FIFO_FRAME(Entry)		D2A_FRAME(Entry)
+#endif
+
+/* With D2A_CALIBRATION, the measured errors of each D/A are corrected for
+ * before its samples go in the FIFO. The gain error is folded into the
+ * voltage gain whenever that is built, so it costs nothing per sample. The
+ * offset and INL can't be folded into a gain, so they're built into a
+ * piecewise-linear correction when the calibration is set, which the
+ * renderer applies to each block in the foreground. Either way the sample
+ * ISR just sends what it's given.
+ *
+ * So that a sample is only rounded once, the renderer leaves calibrated
+ * samples with GAIN_FRAC_BITS of fraction, and CalibrateBlock corrects them
+ * and rounds them to D/A codes. A calibrated gain can go past full scale
+ * (to make up for a D/A that's low), so CalibrateBlock saturates the codes
+ * as well. */
+#if defined (D2A_CALIBRATION)
+#define CAL_GAIN(Channel, Gain)		CalibrateGain(Channel, Gain)
+#define CAL_SEGMENT_SHIFT			(16 - D2A_CAL_SEGMENT_BITS)
+#define CAL_SEGMENT_MASK			((1 << CAL_SEGMENT_SHIFT) - 1)
+#define CAL_VALUE_MAX				0xFFFFL
+#define CAL_ROUND					((1L << GAIN_FRAC_BITS) >> 1)
+#define CAL_GAIN_UNITY				0x8000		// Q15
+#define CAL_GAIN_ERROR_SCALE		10000		// Hundredths of a percent
+#define CAL_SCALE(Lsb, Gain)		((((long)(Lsb) * (Gain)) +					\
+									  (1L << (14 - GAIN_FRAC_BITS))) >>			\
+									 (15 - GAIN_FRAC_BITS))
+#define RENDER_SHIFT				16
+#define RENDER_ROUND				(1UL << 15)
+#define RENDER_GAIN_MAX				0xFFFFUL	// CalibrateGain's limit
+#else
+#define CAL_GAIN(Channel, Gain)		(Gain)
+#define RENDER_SHIFT				(16 + GAIN_FRAC_BITS - FIFO_SHIFT)
+#define RENDER_ROUND				(1UL << (15 + GAIN_FRAC_BITS))
+#define RENDER_GAIN_MAX				(((unsigned long)MAX_VOLTAGE *				\
+									  GAIN_RECIPROCAL +							\
+									  (1UL << (GAIN_RECIPROCAL_SHIFT - 1))) >>	\
+									 GAIN_RECIPROCAL_SHIFT)
+#endif
+
+/* With SIGNAL_DITHER, each sample is kept to DITHER_FRAC_BITS below the D/A
+ * LSB, and dither is added before it's cut to a D/A code. The error from
+ * each cut is taken off the next sample (first-order noise shaping), which
+ * moves the quantization noise, and the dither with it, up towards half the
+ * sample rate and away from the signal. The dither is the sum of two random
+ * bytes, so it's triangular and spans 2 LSB. */
+#if defined (SIGNAL_DITHER)
+#define DITHER_FRAC_BITS		8
+#define DITHER_SHIFT			(16 + GAIN_FRAC_BITS - DITHER_FRAC_BITS)
+#define DITHER_MEAN				255
+#endif
+
+/* Voice levels are a fraction of the output voltage, where MAX_VOICE_LEVEL
+ * is the whole output. Levels are entered in percent. */
+#define MAX_VOICE_LEVEL			0x8000
+#define MAX_VOICE_PERCENT		100
+
+/* Each voice adds up to +/-2^30 (its wave times its level) to the mix,
+ * which is a 32-bit long. Each product is cut down by MIX_SHIFT first, so
+ * all the voices at full level can't overflow the sum before it's clipped. */
+#if (MIXER_VOICES <= 2)
+#define MIX_SHIFT				0
+#elif (MIXER_VOICES <= 4)
+#define MIX_SHIFT				1
+#else
+#define MIX_SHIFT				2
+#endif
+
+/* Extra bits of fraction kept on the gain while it's ramped */
+#define GAIN_RAMP_BITS			14
+
+/* Phase of the main signal at which amplitude changes are committed. This is
+ * the bottom of the sine, where the output is 0 V whatever the amplitude, so
+ * the change doesn't cause a step. */
+#define AMPLITUDE_COMMIT_PHASE	0xC0000000UL
+
+/* Phase accumulator counts per degree: 2^32 / 360 */
+#define PHASE_PER_DEGREE		11930465UL
+
+/* A sweep is run as SWEEP_SEGMENTS straight-line pieces. For a linear sweep
+ * they line up exactly; for a log sweep the segment ends are spaced by a
+ * constant ratio, which keeps the error from a true exponential under 0.1%
+ * for a 100:1 sweep. */
+#define SWEEP_SEGMENT_BITS		6
+#define SWEEP_SEGMENTS			(1 << SWEEP_SEGMENT_BITS)
+#define MAX_SWEEP_TIME			3600	// seconds
+
+/* Limits on modulation. The rate is in tenths of a Hz. The FM deviation is
+ * also cut back to the lowest carrier frequency, so the frequency never goes
+ * negative. */
+#define MAX_MOD_RATE			200		// 20.0 Hz
+#define MAX_AM_DEPTH			100		// percent
+#define MAX_FM_DEVIATION		40		// Hz
+
+/* Voltage gain is the D/A full-scale count for the requested voltage, with
+ * GAIN_FRAC_BITS of fraction. The fraction uses whatever bits the D/A
+ * doesn't, so full scale always fits in 16 bits. */
+#define GAIN_FRAC_BITS			(16 - D2A_BITS)
+
+/* Fixed-point reciprocal used to turn a voltage into a gain without a
+ * divide: Gain = (Voltage * GAIN_RECIPROCAL) >> GAIN_RECIPROCAL_SHIFT. */
+#define GAIN_RECIPROCAL_SHIFT	14
+#define GAIN_RECIPROCAL			(((D2A_FULL_SCALE << GAIN_FRAC_BITS) <<		\
+								  GAIN_RECIPROCAL_SHIFT) / VOLTAGE_FULL_SCALE)
+
+/******************************************************************************
+ * Sine table generation.
+ *
+ * The table is built by the compiler from SAMPLES_PER_PERIOD, so changing the
+ * number of samples never needs hand-typed values. SINE_POLY is the Taylor
+ * series for sin(x) through x^13, which is accurate to better than 1 part in
+ * 10^8 over the quarter period - far finer than the table resolution. All
+ * the arithmetic is done in constant expressions, so none of it is in the
+ * program.
+ ******************************************************************************/
+#define SINE_PI					3.14159265358979324
+#define SINE_X(i)				(((i) + 0.5) * (SINE_PI / 2) / QUARTER_TABLE_SIZE)
+#define SINE_X2(i)				(SINE_X(i) * SINE_X(i))
+#define SINE_POLY(i)			(SINE_X(i) * (1 - SINE_X2(i) / 6 *		\
+								(1 - SINE_X2(i) / 20 *					\
+								(1 - SINE_X2(i) / 42 *					\
+								(1 - SINE_X2(i) / 72 *					\
+								(1 - SINE_X2(i) / 110 *					\
+								(1 - SINE_X2(i) / 156)))))))
+#define SINE_ENTRY(i)			(unsigned int)(SINE_TABLE_PEAK * SINE_POLY(i) + 0.5),
+
+/* Each of these expands to twice as many entries as the one before */
+#define SINE_REP2(i)			SINE_ENTRY(i)     SINE_ENTRY((i) + 1)
+#define SINE_REP4(i)			SINE_REP2(i)      SINE_REP2((i) + 2)
+#define SINE_REP8(i)			SINE_REP4(i)      SINE_REP4((i) + 4)
+#define SINE_REP16(i)			SINE_REP8(i)      SINE_REP8((i) + 8)
+#define SINE_REP32(i)			SINE_REP16(i)     SINE_REP16((i) + 16)
+#define SINE_REP64(i)			SINE_REP32(i)     SINE_REP32((i) + 32)
+#define SINE_REP128(i)			SINE_REP64(i)     SINE_REP64((i) + 64)
+#define SINE_REP256(i)			SINE_REP128(i)    SINE_REP128((i) + 128)
+#define SINE_REP512(i)			SINE_REP256(i)    SINE_REP256((i) + 256)
+#define SINE_REP1024(i)			SINE_REP512(i)    SINE_REP512((i) + 512)
+
+#define SINE_REP_N(n)			SINE_REP_N_(n)
+#define SINE_REP_N_(n)			SINE_REP##n(0)
+
+/* Compile-time checks. A negative array size stops the build. */
+#define STATIC_ASSERT(name, cond)	typedef char name[(cond) ? 1 : -1]
+
+STATIC_ASSERT(QuarterTableSizeCheck,
+			  (QUARTER_TABLE_SIZE == (1 << QUARTER_TABLE_BITS)) &&
+			  (QUARTER_TABLE_SIZE * 4 == SAMPLES_PER_PERIOD));
+STATIC_ASSERT(SineTablePeakCheck, SINE_TABLE_PEAK <= 32767);
+STATIC_ASSERT(GainOverflowCheck,
+			  ((unsigned long)D2A_FULL_SCALE << GAIN_FRAC_BITS) <= 0xFFFFUL);
+STATIC_ASSERT(SampleFifoSizeCheck,
+			  ((SAMPLE_FIFO_SIZE & (SAMPLE_FIFO_SIZE - 1)) == 0) &&
+			  (SAMPLE_BLOCK_SIZE < SAMPLE_FIFO_SIZE));
+STATIC_ASSERT(UserWaveSizeCheck, USER_WAVE_BITS <= 8);
+STATIC_ASSERT(FifoShiftCheck, FIFO_SHIFT <= GAIN_FRAC_BITS);
+STATIC_ASSERT(MixerVoicesCheck, (MIXER_VOICES >= 1) && (MIXER_VOICES <= 8));
+STATIC_ASSERT(MixOverflowCheck,
+			  ((long long)MIXER_VOICES * (-32768LL * MAX_VOICE_LEVEL) >> MIX_SHIFT) >=
+			  -0x80000000LL);
+STATIC_ASSERT(RenderOverflowCheck,
+			  0xFFFFULL * RENDER_GAIN_MAX + RENDER_ROUND <= 0xFFFFFFFFULL);
+STATIC_ASSERT(GainReciprocalCheck,
+			  ((unsigned long long)MAX_VOLTAGE * GAIN_RECIPROCAL +
+			   (1UL << (GAIN_RECIPROCAL_SHIFT - 1))) >> GAIN_RECIPROCAL_SHIFT <=
+			  0xFFFFULL);
+
+#if !defined (SLOW_SINE)
+/* Timer 1 must be able to reach the lowest sample rate with its largest
+ * prescaler. */
+STATIC_ASSERT(MinSampleRateCheck, (F_CPU / 1024 / MIN_SAMPLE_RATE) < 0x10000UL);
+#endif
+STATIC_ASSERT(SampleRateRangeCheck, MIN_SAMPLE_RATE <= MAX_SAMPLE_RATE);
+
+/* Timer 1 clock prescalers. The clock select bits for each are its index
+ * plus one. */
+#define NUM_PRESCALERS			5
 
-// SAMPLES_PER_PERIOD = 100 
 /***************************** Type Definitions *******************************/
+#if !defined (SLOW_SINE)
+static const unsigned int Prescalers[NUM_PRESCALERS] = {1, 8, 64, 256, 1024};
+#endif
 
 
 /**************************** Data Declarations *******************************/
-volatile unsigned int FreqDesired = 40;
+volatile unsigned int FreqDesired = 400;
 volatile unsigned int VoltDesired = 100;
-volatile unsigned int FreqActual = 0;
+volatile unsigned long FreqActual = 0;
 volatile unsigned int VoltActual = 0;
 extern int DisplaySamples;
-/* Table to hold values for sine wave, based on full scale range.
- * Note that "const" variables can be modified once for initialization. */
-static const unsigned int VoltageLookup [SAMPLE_TABLE_SIZE] = {
-	1023, 1022, 1019, 1014, 1007,  998,  987,  974,  960,  943,
-	 925,  906,  884,  862,  838,  812,  786,  758,  729,  700,
-	 670,  639,  607,  576,  544,  512,  479,  447,  416,  384,
-	 353,  323,  294,  265,  237,  211,  185,  161,  139,  117,
-	  98,   80,   63,   49,   36,   25,   16,    9,    4,    1,  0};
-
-/* This array is used for the calculated values for the output sine wave.
- * Each time a new voltage is input, the new values are calculated in the
- * available array and it is then used for output. */
-static unsigned int VoltageScaled[SAMPLE_TABLE_SIZE][2];
+#if defined (SLOW_SINE)
+/* Sample waiting for ShowSample to print it */
+static volatile unsigned int uiShownSample;
+static volatile eBooleanType bSamplePending = FALSE;
+#endif
+/* Quarter period of a sine wave, 0 to SINE_TABLE_PEAK, stored in program
+ * memory. Entry i is sin((i + 1/2) * 90 degrees / QUARTER_TABLE_SIZE), so the
+ * other three quarters are exact mirror images and negatives of it. */
+static const unsigned int SineQuarter [QUARTER_TABLE_SIZE] PROGMEM = {
+	SINE_REP_N(QUARTER_TABLE_SIZE)
+};
+
+/* This array holds the gain used to scale the sine wave to the output
+ * voltage. Each time a new voltage is input, the new gain is calculated in
+ * the available entry and it is then used for output. */
+static volatile unsigned int VoltageGain[2];
 
 /* Since we change this in one thread, and use it in another, we want to
  * make sure the compiler always rereads the value. */
-static volatile unsigned int ucActiveVoltArray = 0;
+static volatile unsigned char ucActiveVoltArray = 0;
+
+/* Incremented every time a new gain is published. The renderer uses it to
+ * spot a new gain, and to check that the gain didn't change while it was
+ * reading it, without having to turn interrupts off. */
+static volatile unsigned char ucGainCount = 0;
+
+/* Number of periods over which a change in amplitude is ramped. With 0, the
+ * amplitude steps straight to the new value. */
+static volatile unsigned char ucRampPeriods = 0;
+
+/* Oscillators that are summed to make the output. Voice 0 is the main signal
+ * set by SetFreq, and the others are added with SetVoice. Each voice's step
+ * is the amount added to its phase accumulator on every sample, so it alone
+ * sets the frequency. These are changed from the menu and copied by the
+ * renderer at the start of each block. */
+typedef struct
+{
+	unsigned long ulStep;		/* Tuning word */
+	unsigned long ulOffset;		/* Phase offset from the accumulator */
+	unsigned int  uiLevel;		/* Amplitude, 0 to MAX_VOICE_LEVEL */
+} VoiceType;
+
+static volatile VoiceType Voices[MIXER_VOICES] = {
+	{ 0, 0, MAX_VOICE_LEVEL }
+};
+
+/* Number of voices being mixed: one more than the highest voice with a
+ * non-zero level. Voice 0 is always mixed. */
+static volatile unsigned char ucNumVoices = 1;
+
+/* Frequency in Hz of each extra voice, kept so its tuning word can be worked
+ * out again when the sample rate changes. */
+static unsigned int VoiceFreq[MIXER_VOICES];
+
+/* Waveform being output. A single byte, so it can be changed at any time. */
+volatile unsigned char Waveform = WAVE_SINE;
+
+/* User-defined waveform, covering one full period. Entries are offset
+ * binary, with mid-scale at 0x8000. */
+static unsigned int UserWaveTable[USER_WAVE_SIZE];
+
+/* Sweep requested from the menu. ucSweepCommand is written last, and tells
+ * the renderer to pick up the request or to stop the sweep. */
+typedef enum {
+	SWEEP_IDLE,
+	SWEEP_START,
+	SWEEP_STOP
+} eSweepCommandType;
+
+typedef struct
+{
+	unsigned long ulStartStep;		/* Tuning word at the start */
+	unsigned long ulStopStep;		/* Tuning word at the end */
+	unsigned long ulRatio;			/* Log sweep: step ratio per segment, Q16 */
+	unsigned long ulSegmentLength;	/* Samples per segment */
+	eSweepType Type;
+} SweepRequestType;
+
+static SweepRequestType SweepRequest;
+static volatile unsigned char ucSweepCommand = SWEEP_IDLE;
+
+/* Sweep state. Only used by the renderer, except for the sample counts,
+ * which are published for GetSweepProgress. */
+static eBooleanType bSweepActive = FALSE;
+static SweepRequestType Sweep;
+static unsigned long ulSweepStep;		/* Present tuning word */
+static unsigned long ulSegmentEnd;		/* Tuning word at end of segment */
+static unsigned long ulSegmentLeft;		/* Samples left in the segment */
+static unsigned char ucSegment;			/* Segments started */
+static long lSweepDelta;				/* Change in step per sample... */
+static unsigned int uiSweepDeltaFrac;	/* ...plus this many 1/65536ths */
+static unsigned int uiSweepFracSum;
+static volatile unsigned long ulSweepRemaining = 0;
+static volatile unsigned long ulSweepTotal = 0;
+
+/* Modulation of the output by a low-rate sine. Set from the menu, and copied
+ * by the renderer at the start of each block. A zero depth turns that type
+ * of modulation off, so the renderer doesn't need to check the type. */
+typedef struct
+{
+	unsigned long ulStep;		/* Tuning word of the modulating sine */
+	unsigned int uiAmDepth;		/* Half the AM depth, 0 to 0x4000 */
+	unsigned int uiFmDeviation;	/* FM deviation, as tuning word >> 15 */
+} ModulationType;
+
+static volatile ModulationType Modulation;
+static unsigned long ulModPhase = 0;
+
+/* Modulation as it was requested, so it can be worked out again when the
+ * sample rate changes */
+static eModulationType ModRequest = MOD_NONE;
+static unsigned int uiModRate, uiModDepth;
+
+/* Sample rate plan, and the range of frequencies the main signal covers,
+ * which the plan was made for. One Hz is 2^32/sample rate counts of tuning
+ * word. For a tenth of a Hz, the whole part and the fraction (in 1/65536ths)
+ * are kept separately, so a tuning word can be calculated without a divide. */
+static SignalPlanType Plan;
+static unsigned int uiPlanLowFreq, uiPlanHighFreq;
+static unsigned long ulTuningWhole;
+static unsigned int uiTuningFrac;
+
+/* Parameters committed by the renderer. Changes to the main signal's
+ * frequency and amplitude only take effect at set points in its period.
+ * The gain has GAIN_RAMP_BITS of extra fraction, so it can be ramped in
+ * small steps. */
+static unsigned long ulMainStep = 0;	/* Main signal's tuning word */
+static long lRampGain = 0;				/* Gain being output */
+static long lRampStep;					/* Change in gain per sample */
+static unsigned long ulRampLeft = 0;	/* Samples left in the ramp */
+static unsigned int uiRampTarget;		/* Gain at the end of the ramp */
+static unsigned char ucGainCountSeen = 0;
+
+/* Phase accumulator for each voice. Only used by RenderSamples. */
+static unsigned long VoicePhase[MIXER_VOICES];
+
+/* Samples rendered by the foreground, waiting to be output by the ISR. The
+ * foreground only moves the head and the ISR only moves the tail. Both are
+ * single bytes, so no locking is needed. */
+static unsigned int SampleFifo[SAMPLE_FIFO_SIZE];
+static volatile unsigned char ucSampleHead = 0;
+static volatile unsigned char ucSampleTail = 0;
+
+#if (D2A_CHANNELS > 1)
+/* Signals for the extra D/A channels. Channel 0 is the main output, made by
+ * RenderSamples; each of the others is a single oscillator with its own
+ * frequency, amplitude and waveform. These are set from the menu, and copied
+ * by the renderer at the start of each block. Arrays are indexed by the
+ * channel number less one. */
+typedef struct
+{
+	unsigned long ulStep;		/* Tuning word */
+	unsigned int  uiGain;		/* Voltage gain, as in VoltageGain */
+	unsigned char ucWaveform;
+} ChannelType;
 
+static volatile ChannelType Channels[D2A_CHANNELS - 1];
+static unsigned int ChannelFreq[D2A_CHANNELS - 1];		/* Tenths of a Hz */
+static unsigned int ChannelVolt[D2A_CHANNELS - 1];		/* Hundredths of a V */
+static unsigned long ChannelPhase[D2A_CHANNELS - 1];
+
+/* Samples for the extra channels. They share the FIFO's head and tail. */
+static unsigned int ChannelFifo[D2A_CHANNELS - 1][SAMPLE_FIFO_SIZE];
+#endif
+
+/* D/A frames for the sample ISR to write next time round, and the FIFO entry
+ * the first was made from. They're made at the end of each run, so the
+ * next run can start by writing them. */
+static unsigned int OutputFrames[D2A_CHANNELS];
+static unsigned int uiOutputValue;
+
+#if defined (SIGNAL_DITHER)
+/* Random number state for the dither, and the error carried from the last
+ * sample of each D/A to the next. */
+static unsigned int uiDitherRandom = 1;
+static long DitherCarry[D2A_CHANNELS];
+#endif
+
+#if defined (D2A_CALIBRATION)
+/* Corrections for each D/A, built from its calibration: the gain as a Q15
+ * factor, the offset, and for each segment of the code range the INL
+ * correction at its start and the change across it. The offset and INL are
+ * in the units the renderer leaves calibrated samples in, 2^-GAIN_FRAC_BITS
+ * of an LSB, and have been through the gain factor too. */
+typedef struct
+{
+	unsigned int uiGain;
+	eBooleanType bPiecewise;	/* Any offset or INL to correct */
+	long lOffset;
+	long lBase[1 << D2A_CAL_SEGMENT_BITS];
+	long lSlope[1 << D2A_CAL_SEGMENT_BITS];
+} CalCorrectionType;
+
+static CalCorrectionType CalCorrections[D2A_CHANNELS];
+static D2ACalType Calibrations[D2A_CHANNELS];
+#endif
+
+/* Number of times the ISR found the FIFO empty */
+static volatile unsigned int uiSampleUnderruns = 0;
+
+#if defined (SIGNAL_CAPTURE)
+/* D/A codes captured as they're rendered, and the Timer 3 clocks spent
+ * rendering them. Timer 3 free-runs at F_CPU while a capture is going. */
+static unsigned int CaptureBuffer[CAPTURE_SIZE];
+static volatile unsigned int uiCaptureCount = CAPTURE_SIZE;
+static unsigned long ulCaptureCycles;
+static unsigned int uiCaptureTimed;
+#endif
 
 /*************************** Function Prototypes ******************************/
+static unsigned long FreqToTuningWord(unsigned int);
+static void PlanSignal(void);
+static unsigned int GainForVoltage(unsigned int);
+#if defined (D2A_CALIBRATION)
+static void BuildCalibration(unsigned char);
+static unsigned int CalibrateGain(unsigned char, unsigned int);
+static void CalibrateBlock(unsigned char, unsigned int *, unsigned char);
+#endif
+#if (D2A_CHANNELS > 1)
+static void RenderChannel(unsigned char, unsigned int *, unsigned char);
+#endif
+static inline unsigned int SineSample(unsigned int);
+#if defined (SIGNAL_DITHER)
+static inline unsigned int DitherSample(unsigned long, long *);
+#endif
+static unsigned long SqrtQ16(unsigned long);
+static void StartSegment(void);
+static unsigned long AdvanceSweep(void);
+static void CommitGain(void);
+static void LoadOutputFrames(void);
 
 
 
@@ -77,8 +525,38 @@ static volatile unsigned int ucActiveVoltArray = 0;
  ******************************************************************************/
 void initSine(void)
 {
+    unsigned char i;
+
+#if defined (D2A_CALIBRATION)
+    // Corrections for each D/A, before any gain is built
+    for (i = 0; i < D2A_CHANNELS; i++)
+    {
+        (void)ReadDtoACal(i, &Calibrations[i]);
+        BuildCalibration(i);
+    }
+#endif
+
     // Generate new values to output for sine wave
     CalcSineValues(VoltDesired);
+
+    // User waveform is flat until it's loaded
+    for (i = 0; i < USER_WAVE_SIZE; i++)
+    {
+        UserWaveTable[i] = 0x8000;
+    }
+
+    // Start at the initial frequency
+    SetFreq(FreqDesired);
+
+    // Fill the sample FIFO, and have the first sample ready to write
+    ServiceSignal();
+    LoadOutputFrames();
+
+#if defined (SLOW_SINE)
+    /* Output one sample every medium-thread tick. The tuning word is based
+     * on MAX_SAMPLE_RATE, so the signal plays back slowed down. */
+    AddMediumTask(UpdateSignal, 1);
+#endif
 	
 	// Initialize D/A for sine wave output
 	InitDtoA();
@@ -105,10 +583,13 @@ eErrorType SetFreq(unsigned int Freq)
     {   // No problems found with value
         FreqDesired = Freq;
 
-#if !defined (SLOW_SINE)
-        // Report new frequency to Sine Wave interrupt
-		UpdateFreqCnt();
-#endif
+        // A new frequency ends any sweep in progress
+        ucSweepCommand = SWEEP_STOP;
+
+        // Pick the sample rate, and report the new frequency to the renderer
+        uiPlanLowFreq = Freq;
+        uiPlanHighFreq = Freq;
+        PlanSignal();
     }
 
     return ReturnVal;
@@ -144,91 +625,1321 @@ eErrorType SetVolt(unsigned int Volt)
 
 
 /******************************************************************************
- * This function calculates a new set of values for a sine wave. It "populates"
- * the unused column of the VoltageScaled array with the new values, and then
- * switches that column to be the active one.
+ * Sweep the main signal from StartFreq to StopFreq, in tenths of a Hz, over
+ * Duration
+ * seconds. The frequency changes every sample, either linearly or
+ * logarithmically, and the phase stays continuous throughout. When the sweep
+ * is done, the output stays at StopFreq. The sample rate is planned for the
+ * whole range, so it doesn't change during the sweep.
+ *
+ * Everything that needs a divide or a root is worked out here, so the
+ * renderer only adds.
  ******************************************************************************/
-void CalcSineValues ( unsigned int NewVoltage )
+eErrorType StartSweep(unsigned int StartFreq, unsigned int StopFreq,
+                      unsigned int Duration, eSweepType Type)
+{
+    eErrorType ReturnVal = NO_ERROR;
+    unsigned long ulRatio;
+    unsigned char i;
+
+    if ((StartFreq < MIN_FREQUENCY) || (StartFreq > MAX_FREQUENCY) ||
+        (StopFreq < MIN_FREQUENCY) || (StopFreq > MAX_FREQUENCY) ||
+        (Duration == 0) || (Duration > MAX_SWEEP_TIME) ||
+        ((unsigned int)Type > SWEEP_LOG))
+    {   // Parameter is out of range
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+
+    else if ((StartFreq % FREQUENCY_INCREMENT != 0) ||
+             (StopFreq % FREQUENCY_INCREMENT != 0))
+    {   // Invalid value
+        ReturnVal = INVALID_PARAMETER;
+    }
+
+    else
+    {   // The output ends up at the stop frequency, so set that first
+        FreqDesired = StopFreq;
+        ucSweepCommand = SWEEP_STOP;
+
+        uiPlanLowFreq = (StartFreq < StopFreq) ? StartFreq : StopFreq;
+        uiPlanHighFreq = (StartFreq < StopFreq) ? StopFreq : StartFreq;
+        PlanSignal();
+
+        SweepRequest.ulStartStep = FreqToTuningWord(StartFreq);
+        SweepRequest.ulStopStep = FreqToTuningWord(StopFreq);
+        SweepRequest.ulSegmentLength =
+            (Duration * Plan.ulSampleRate) >> SWEEP_SEGMENT_BITS;
+        SweepRequest.Type = Type;
+
+        /* Ratio of one segment end to the next is the overall ratio to the
+         * power 1/SWEEP_SEGMENTS, found by taking square roots. */
+        ulRatio = (unsigned long)
+            (((unsigned long long)StopFreq << 16) / StartFreq);
+        for (i = 0; i < SWEEP_SEGMENT_BITS; i++)
+        {
+            ulRatio = SqrtQ16(ulRatio);
+        }
+        SweepRequest.ulRatio = ulRatio;
+
+        ucSweepCommand = SWEEP_START;
+    }
+
+    return ReturnVal;
+}
+
+/******************************************************************************
+ * Returns how far through the sweep the output is, in percent. Returns 100
+ * when no sweep is running.
+ ******************************************************************************/
+unsigned char GetSweepProgress(void)
 {
+    unsigned long ulRemaining, ulTotal;
+    unsigned char ucProgress = 100;
 
-	/* Assignment
-	 * Using the "unused" array, populate it with values for the scaled
-	 * voltage. Remember to scale the calculation so that you don't lose
-	 * resolution, and you don't have overflow.
-	 *
-	 * Lastly, switch ucActiveVoltArray to point to this new array of
-	 * values.
-	 */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ulRemaining = ulSweepRemaining;
+        ulTotal = ulSweepTotal;
+    }
 
-	int i;
+    if (ulRemaining != 0)
+    {
+        ucProgress = 100 - (unsigned char)(ulRemaining / ((ulTotal + 99) / 100));
+    }
 
-	if(ucActiveVoltArray == 0){
-	 	ucActiveVoltArray = 1;
-	} else{
-		ucActiveVoltArray = 0;
-	}
+    return ucProgress;
+}
 
-	for(i = 0; i < SAMPLE_TABLE_SIZE; i++){
-		VoltageScaled[i][ucActiveVoltArray] = (VoltageLookup[i] * (NewVoltage / 10)) / 50;
-	}
+/******************************************************************************
+ * Modulate the output with a sine at Rate tenths of a Hz. For AM, Depth is
+ * the percent by which the amplitude dips below the set voltage. For FM,
+ * Depth is the peak deviation of the main signal, in Hz. MOD_NONE turns
+ * modulation off.
+ ******************************************************************************/
+eErrorType SetModulation(eModulationType Type, unsigned int Rate,
+                         unsigned int Depth)
+{
+    eErrorType ReturnVal = NO_ERROR;
 
-	VoltActual = NewVoltage;
+    if (((unsigned int)Type > MOD_FM) ||
+        ((Type != MOD_NONE) && ((Rate == 0) || (Rate > MAX_MOD_RATE))) ||
+        ((Type == MOD_AM) && (Depth > MAX_AM_DEPTH)) ||
+        ((Type == MOD_FM) && (Depth > MAX_FM_DEVIATION)))
+    {   // Parameter is out of range
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
 
+    if (ReturnVal == NO_ERROR)
+    {   // No problems found with values. The plan works out the tuning words.
+        ModRequest = Type;
+        uiModRate = Rate;
+        uiModDepth = Depth;
+        PlanSignal();
+    }
+
+    return ReturnVal;
+}
+
+/******************************************************************************
+ * Set up one of the extra voices that is mixed with the main signal. Freq is
+ * in Hz, Level is the percent of the output voltage, and Phase is the offset
+ * in degrees. A level of 0 turns the voice off. Voice 0 is the main signal,
+ * and is set with SetFreq.
+ ******************************************************************************/
+eErrorType SetVoice(unsigned char Voice, unsigned int Freq,
+                    unsigned int Level, unsigned int Phase)
+{
+    eErrorType ReturnVal = NO_ERROR;
+    unsigned int uiLevel;
+    unsigned char i, ucVoices;
+
+    if ((Voice == 0) || (Voice >= MIXER_VOICES) ||
+        (Freq > MAX_VOICE_FREQUENCY) || (Level > MAX_VOICE_PERCENT) ||
+        (Phase >= 360))
+    {   // Parameter is out of range
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+
+    if (ReturnVal == NO_ERROR)
+    {   // No problems found with values
+        uiLevel = (unsigned int)(((unsigned long)Level * MAX_VOICE_LEVEL) /
+                                 MAX_VOICE_PERCENT);
+        VoiceFreq[Voice] = Freq;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            Voices[Voice].ulOffset = Phase * PHASE_PER_DEGREE;
+            Voices[Voice].uiLevel = uiLevel;
+        }
+
+        // Only mix up to the last voice that's turned on
+        ucVoices = 1;
+        for (i = 1; i < MIXER_VOICES; i++)
+        {
+            if (Voices[i].uiLevel != 0)
+            {
+                ucVoices = i + 1;
+            }
+        }
+        ucNumVoices = ucVoices;
+
+        // The voice may need a faster sample rate; this also sets its step
+        PlanSignal();
+    }
+
+    return ReturnVal;
+}
+
+#if (D2A_CHANNELS > 1)
+/******************************************************************************
+ * Set the signal on one of the extra D/A channels. Freq is in tenths of a Hz
+ * and Volt in hundredths of a volt, as for the main signal. A voltage of 0
+ * turns the channel off. Channel 0 is the main signal.
+ ******************************************************************************/
+eErrorType SetChannel(unsigned char Channel, unsigned int Freq,
+                      unsigned int Volt, eWaveformType NewWaveform)
+{
+    eErrorType ReturnVal = NO_ERROR;
+    unsigned int uiGain;
+
+    if ((Channel == 0) || (Channel >= D2A_CHANNELS) ||
+        (Freq > MAX_FREQUENCY) ||
+        ((Volt != 0) && ((Volt < MIN_VOLTAGE) || (Volt > MAX_VOLTAGE))) ||
+        ((unsigned int)NewWaveform >= NUM_WAVEFORMS))
+    {   // Parameter is out of range
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+
+    if (ReturnVal == NO_ERROR)
+    {   // No problems found with values
+        uiGain = CAL_GAIN(Channel, GainForVoltage(Volt));
+        ChannelFreq[Channel - 1] = Freq;
+        ChannelVolt[Channel - 1] = Volt;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            Channels[Channel - 1].uiGain = uiGain;
+            Channels[Channel - 1].ucWaveform = NewWaveform;
+        }
+
+        // The channel may need a faster sample rate; this also sets its step
+        PlanSignal();
+    }
+
+    return ReturnVal;
+}
+#endif /* D2A_CHANNELS > 1 */
+
+/******************************************************************************
+ * Set the number of periods of the main signal over which a change in
+ * amplitude is ramped. 0 makes the change in one step.
+ ******************************************************************************/
+void SetRampPeriods(unsigned char Periods)
+{
+    ucRampPeriods = Periods;
+}
+
+/******************************************************************************
+ * Select the waveform to output. Takes effect on the next rendered block,
+ * without stopping the output.
+ ******************************************************************************/
+eErrorType SetWaveform(eWaveformType NewWaveform)
+{
+    eErrorType ReturnVal = NO_ERROR;
+
+    if ((unsigned int)NewWaveform >= NUM_WAVEFORMS)
+    {   // No such waveform
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+    else
+    {
+        Waveform = NewWaveform;
+    }
+
+    return ReturnVal;
+}
+
+/******************************************************************************
+ * Set one point of the user-defined waveform. Value is offset binary, with
+ * 0x8000 at mid-scale.
+ ******************************************************************************/
+eErrorType SetUserWavePoint(unsigned char Index, unsigned int Value)
+{
+    eErrorType ReturnVal = NO_ERROR;
+
+    if (Index >= USER_WAVE_SIZE)
+    {   // Index is out of range
+        ReturnVal = PARAMETER_OUT_OF_RANGE;
+    }
+    else
+    {
+        /* The renderer can interrupt a 16-bit write in the foreground */
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            UserWaveTable[Index] = Value;
+        }
+    }
+
+    return ReturnVal;
+}
+
+/******************************************************************************
+ * This function calculates a new gain for the sine wave. It "populates"
+ * the unused entry of the VoltageGain array with the new value, and then
+ * switches that entry to be the active one.
+ ******************************************************************************/
+void CalcSineValues ( unsigned int NewVoltage )
+{
+	unsigned char ucNewArray = ucActiveVoltArray ^ 1;
+
+	VoltageGain[ucNewArray] = CAL_GAIN(0, GainForVoltage(NewVoltage));
+
+	/* Only now that the new gain is complete, switch the renderer over to
+	 * it. This is a single byte write, so the renderer sees either the old
+	 * gain or the new one, never a mix. The count tells the renderer that
+	 * there's a new gain to commit. */
+	ucActiveVoltArray = ucNewArray;
+	++ucGainCount;
+
+	VoltActual = NewVoltage;
 
 } // End of CalcSineValues
  
 /******************************************************************************
- * This file outputs the next sine wave value.
- *
- * Previous sine wave value is output first to reduce any errors in variance of
- * execution time of this function.
- * 
- * Since we want to minimize the time in this function, no error checking or
- * other "niceties" are done.
+ * Converts a voltage to a gain: NewVoltage * full-scale gain /
+ * VOLTAGE_FULL_SCALE. The divide is done at compile time as a reciprocal, so
+ * this is one multiply and a shift, and the voltage keeps all of its
+ * resolution.
  ******************************************************************************/
-void UpdateSignal( )
+static unsigned int GainForVoltage(unsigned int Voltage)
 {
-	static unsigned char ucVoltageIndex = 0;
-	static unsigned int DACValue = 0;
-	/* This variable specifies whether we're increasing (1) or decreasing the
-	 * voltage value. */
-	static unsigned char Direction = 1;
+	return (unsigned int)
+		(((unsigned long)Voltage * GAIN_RECIPROCAL +
+		  (1UL << (GAIN_RECIPROCAL_SHIFT - 1))) >> GAIN_RECIPROCAL_SHIFT);
+}
 
-#if defined (SLOW_SINE)
-    char *pDebugStr;
-    char DebugStr[10];
+#if defined (D2A_CALIBRATION)
+/******************************************************************************
+ * Sets the calibration of a D/A, queues it to be saved in EEPROM, and
+ * rebuilds that D/A's gain with it. Errors are the measured ones: the
+ * correction is the reverse.
+ ******************************************************************************/
+eErrorType SetCalibration(unsigned char ucChannel, const D2ACalType *pCal)
+{
+	eErrorType ReturnVal = NO_ERROR;
+#if (D2A_CHANNELS > 1)
+	unsigned int uiGain;
 #endif
 
-	/* Assignment
-	 * Get the new value to output and put it in DACValue.
-	 */
+	if ((ucChannel >= D2A_CHANNELS) ||
+		(pCal->iOffset > D2A_CAL_MAX_OFFSET) ||
+		(pCal->iOffset < -D2A_CAL_MAX_OFFSET) ||
+		(pCal->iGainError > D2A_CAL_MAX_GAIN_ERROR) ||
+		(pCal->iGainError < -D2A_CAL_MAX_GAIN_ERROR))
+	{	// Parameter is out of range
+		ReturnVal = PARAMETER_OUT_OF_RANGE;
+	}
+
+	if (ReturnVal == NO_ERROR)
+	{	// No problems found with values
+		Calibrations[ucChannel] = *pCal;
+		WriteDtoACal(ucChannel, pCal);
+
+		// The renderer runs in the foreground too, so it can't see this half done
+		BuildCalibration(ucChannel);
 
-	if(ucVoltageIndex == 0){
-		Direction = 1;
-	} else if(ucVoltageIndex == (SAMPLE_TABLE_SIZE - 1)){
-		Direction = 0;
+		if (ucChannel == 0)
+		{
+			CalcSineValues(VoltDesired);
+		}
+#if (D2A_CHANNELS > 1)
+		else
+		{
+			uiGain = CalibrateGain(ucChannel,
+								   GainForVoltage(ChannelVolt[ucChannel - 1]));
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				Channels[ucChannel - 1].uiGain = uiGain;
+			}
+		}
+#endif
 	}
 
-	if(Direction == 1){
-		ucVoltageIndex++;
-	} else{
-		ucVoltageIndex--;
+	return ReturnVal;
+}
+
+/******************************************************************************
+ * Returns the calibration of a D/A.
+ ******************************************************************************/
+void GetCalibration(unsigned char ucChannel, D2ACalType *pCal)
+{
+	*pCal = Calibrations[ucChannel];
+}
+
+/******************************************************************************
+ * Builds the corrections for a D/A from its calibration. The gain factor is
+ * the reciprocal of the gain error. A D/A code c gives
+ *   c * (1 + gain error) + offset + INL(c)
+ * so the code for a sample x is (x - offset - INL(c)) times the gain factor.
+ * The renderer has already applied the factor to x, so the offset and INL
+ * corrections are the reverse of the errors, times the factor too. The INL
+ * segments join the correction at each point.
+ ******************************************************************************/
+static void BuildCalibration(unsigned char ucChannel)
+{
+	const D2ACalType *pCal = &Calibrations[ucChannel];
+	CalCorrectionType *pCorrection = &CalCorrections[ucChannel];
+	unsigned int uiGain;
+	long lThis, lNext;
+	unsigned char i;
+
+	uiGain = (unsigned int)
+		(((unsigned long)CAL_GAIN_UNITY * CAL_GAIN_ERROR_SCALE +
+		  (CAL_GAIN_ERROR_SCALE + pCal->iGainError) / 2) /
+		 (CAL_GAIN_ERROR_SCALE + pCal->iGainError));
+	pCorrection->uiGain = uiGain;
+
+	pCorrection->bPiecewise = (pCal->iOffset != 0) ? TRUE : FALSE;
+	pCorrection->lOffset = CAL_SCALE(-pCal->iOffset, uiGain);
+	lThis = CAL_SCALE(-pCal->scInl[0], uiGain);
+	for (i = 0; i < (1 << D2A_CAL_SEGMENT_BITS); i++)
+	{
+		lNext = CAL_SCALE(-pCal->scInl[i + 1], uiGain);
+		pCorrection->lBase[i] = lThis;
+		pCorrection->lSlope[i] = lNext - lThis;
+		if (pCal->scInl[i] != 0)
+		{
+			pCorrection->bPiecewise = TRUE;
+		}
+		lThis = lNext;
+	}
+	if (pCal->scInl[D2A_CAL_POINTS - 1] != 0)
+	{
+		pCorrection->bPiecewise = TRUE;
 	}
+}
 
-	DACValue = VoltageScaled[ucVoltageIndex][ucActiveVoltArray];
+/******************************************************************************
+ * Corrects a voltage gain for the gain error of a D/A. This is done when the
+ * gain is built, never per sample. The gain is held to RENDER_GAIN_MAX, so
+ * the renderer can't overflow; any codes past full scale it makes are
+ * clipped by CalibrateBlock.
+ ******************************************************************************/
+static unsigned int CalibrateGain(unsigned char ucChannel, unsigned int uiGain)
+{
+	unsigned long ulGain = ((unsigned long)uiGain *
+							CalCorrections[ucChannel].uiGain +
+							(CAL_GAIN_UNITY / 2)) >> 15;
 
-	WriteDtoASample(DACValue);
+	return (ulGain > RENDER_GAIN_MAX) ? (unsigned int)RENDER_GAIN_MAX :
+									   (unsigned int)ulGain;
+}
 
+/******************************************************************************
+ * Turns a block of rendered samples for a D/A into FIFO entries. The offset
+ * and INL corrections are added while the samples still have their
+ * fraction, and then they're rounded, or dithered, to the codes the D/A has.
+ * The INL is looked up with the offset already taken out, which is close to
+ * the code it will be made with.
+ ******************************************************************************/
+static void CalibrateBlock(unsigned char ucChannel, unsigned int *pBuffer,
+						   unsigned char ucCount)
+{
+	const CalCorrectionType *pCorrection = &CalCorrections[ucChannel];
+	unsigned char ucSegment;
+	long lValue;
+#if !defined (SIGNAL_DITHER)
+	long lCode;
+#endif
 
-if ( DisplaySamples )
+	while (ucCount-- != 0)
 	{
-	#if defined (SLOW_SINE)
-		SCIWriteString("Sample  = ");
-    	pDebugStr = DebugStr;
-		_itoa(&pDebugStr, DACValue, 10);
-		SCIWriteString(DebugStr);
-    	SCIWriteString("\r\n");
-	#endif
+		lValue = (long)*pBuffer;
+
+		if (pCorrection->bPiecewise == TRUE)
+		{
+			lValue += pCorrection->lOffset;
+			if (lValue < 0)
+			{
+				lValue = 0;
+			}
+			else if (lValue > CAL_VALUE_MAX)
+			{
+				lValue = CAL_VALUE_MAX;
+			}
+
+			ucSegment = (unsigned char)(lValue >> CAL_SEGMENT_SHIFT);
+			lValue += pCorrection->lBase[ucSegment] +
+					  ((pCorrection->lSlope[ucSegment] *
+						(lValue & CAL_SEGMENT_MASK) +
+						(1L << (CAL_SEGMENT_SHIFT - 1))) >> CAL_SEGMENT_SHIFT);
+			if (lValue < 0)
+			{
+				lValue = 0;
+			}
+			else if (lValue > CAL_VALUE_MAX)
+			{
+				lValue = CAL_VALUE_MAX;
+			}
+		}
+
+#if defined (SIGNAL_DITHER)
+		*pBuffer++ = DitherSample((unsigned long)lValue << 16,
+								  &DitherCarry[ucChannel]);
+#else
+		lCode = (lValue + CAL_ROUND) >> GAIN_FRAC_BITS;
+		if (lCode > (long)D2A_FULL_SCALE)
+		{
+			lCode = D2A_FULL_SCALE;
+		}
+		*pBuffer++ = (unsigned int)lCode << FIFO_SHIFT;
+#endif
 	}
+}
+#endif /* D2A_CALIBRATION */
 
-}  // End of UpdateSignal
+/******************************************************************************
+ * Returns the sample rate plan in use.
+ ******************************************************************************/
+void GetSignalPlan(SignalPlanType *pPlan)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *pPlan = Plan;
+    }
+}
+
+/******************************************************************************
+ * Converts a frequency in tenths of a Hz to the phase accumulator tuning
+ * word, Freq * 2^32 / (10 * sample rate), using multiplies only.
+ ******************************************************************************/
+static unsigned long FreqToTuningWord(unsigned int Freq)
+{
+	return ((unsigned long)Freq * ulTuningWhole) +
+		   (((unsigned long)Freq * uiTuningFrac) >> 16);
+}
+
+/******************************************************************************
+ * Plans the sample rate for the main signal's frequency range and the extra
+ * voices, then works out every tuning word for that rate.
+ *
+ * The rate is the one that gives SAMPLES_PER_PERIOD samples in a period of
+ * the highest frequency in the output, which uses every entry in the table.
+ * It is held between MIN_SAMPLE_RATE and MAX_SAMPLE_RATE, so above
+ * MAX_SAMPLE_RATE / SAMPLES_PER_PERIOD the rate stays at the CPU budget and
+ * the samples per period fall instead. Timer 1 gets the smallest prescaler
+ * that fits the period in 16 bits, which keeps the most resolution, plus
+ * the fraction of a count left over for the divider in the ISR.
+ *
+ * Frequency changes within the same rate are still committed at the end of
+ * a period. A change of rate takes effect straight away, so the period in
+ * progress is stretched or shrunk, and a sweep can't carry on through it.
+ ******************************************************************************/
+static void PlanSignal(void)
+{
+	unsigned long ulTop = uiPlanHighFreq;
+	unsigned long ulRate, ulStep;
+	unsigned long long ullTuning;
+	unsigned int uiDeviation;
+	unsigned char i;
+#if !defined (SLOW_SINE)
+	unsigned long ulPeriod;
+#endif
+
+	// Highest frequency in the output, in tenths of a Hz
+	for (i = 1; i < MIXER_VOICES; i++)
+	{
+		if ((Voices[i].uiLevel != 0) &&
+			((unsigned long)VoiceFreq[i] * FREQ_SCALE > ulTop))
+		{
+			ulTop = (unsigned long)VoiceFreq[i] * FREQ_SCALE;
+		}
+	}
+#if (D2A_CHANNELS > 1)
+	for (i = 0; i < D2A_CHANNELS - 1; i++)
+	{
+		if ((Channels[i].uiGain != 0) && (ChannelFreq[i] > ulTop))
+		{
+			ulTop = ChannelFreq[i];
+		}
+	}
+#endif
+
+	ulRate = (ulTop * SAMPLES_PER_PERIOD) / FREQ_SCALE;
+	if (ulRate > MAX_SAMPLE_RATE)
+	{
+		ulRate = MAX_SAMPLE_RATE;
+	}
+	else if (ulRate < MIN_SAMPLE_RATE)
+	{
+		ulRate = MIN_SAMPLE_RATE;
+	}
+
+	if (ulRate != Plan.ulSampleRate)
+	{	// Change the sample rate
+		if (Plan.ulSampleRate != 0)
+		{	// Tuning words in a running sweep are for the old rate
+			ucSweepCommand = SWEEP_STOP;
+		}
+
+#if !defined (SLOW_SINE)
+		for (i = 0; ((F_CPU / Prescalers[i]) / ulRate) >= 0x10000UL; i++)
+		{	// Try the next prescaler
+		}
+
+		ulPeriod = (unsigned long)(((unsigned long long)F_CPU << 16) /
+								   ((unsigned long)Prescalers[i] * ulRate));
+		Plan.uiPrescaler = Prescalers[i];
+		Plan.uiTimerCount = (unsigned int)(ulPeriod >> 16) - 1;
+		Plan.uiTimerFrac = (unsigned int)(ulPeriod & 0xFFFF);
+		SetTimer1Period(i + 1, Plan.uiTimerCount, Plan.uiTimerFrac);
+#endif
+		Plan.ulSampleRate = ulRate;
+
+		ullTuning = 0x1000000000000ULL / (ulRate * FREQ_SCALE);
+		ulTuningWhole = (unsigned long)(ullTuning >> 16);
+		uiTuningFrac = (unsigned int)(ullTuning & 0xFFFF);
+	}
+
+	Plan.ulSamplesPerPeriod = (ulRate * FREQ_SCALE) / FreqDesired;
+
+	// Main signal
+	ulStep = FreqToTuningWord(FreqDesired);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		Voices[0].ulStep = ulStep;
+	}
+
+	/* Frequency actually produced, after rounding of the tuning word, in
+	 * hundredths of a Hz. Timer 1 holds the average sample rate at the
+	 * planned rate, so the tuning word is the only source of error. */
+	FreqActual = (unsigned long)
+		((((unsigned long long)ulStep * (ulRate * FREQ_ACTUAL_SCALE)) +
+		  0x80000000UL) >> 32);
+
+	// Extra voices
+	for (i = 1; i < MIXER_VOICES; i++)
+	{
+		ulStep = FreqToTuningWord(VoiceFreq[i] * FREQ_SCALE);
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			Voices[i].ulStep = ulStep;
+		}
+	}
+
+#if (D2A_CHANNELS > 1)
+	// Extra D/A channels
+	for (i = 0; i < D2A_CHANNELS - 1; i++)
+	{
+		ulStep = FreqToTuningWord(ChannelFreq[i]);
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			Channels[i].ulStep = ulStep;
+		}
+	}
+#endif
+
+	// Modulation. The FM deviation can't be more than the lowest carrier.
+	uiDeviation = uiModDepth * FREQ_SCALE;
+	if (uiDeviation > uiPlanLowFreq)
+	{
+		uiDeviation = uiPlanLowFreq;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		Modulation.ulStep = (ModRequest == MOD_NONE) ? 0 :
+			FreqToTuningWord(uiModRate);
+		Modulation.uiAmDepth = (ModRequest != MOD_AM) ? 0 :
+			(unsigned int)(((unsigned long)uiModDepth << 14) / 100);
+		Modulation.uiFmDeviation = (ModRequest != MOD_FM) ? 0 :
+			(unsigned int)(FreqToTuningWord(uiDeviation) >> 15);
+	}
+}
+
+/******************************************************************************
+ * Square root of a Q16 fixed-point value, also in Q16.
+ ******************************************************************************/
+static unsigned long SqrtQ16(unsigned long ulValue)
+{
+	unsigned long long ullRemainder = (unsigned long long)ulValue << 16;
+	unsigned long long ullBit = 1ULL << 62;
+	unsigned long long ullRoot = 0;
+
+	// Find the highest power of 4 that's not greater than the value
+	while (ullBit > ullRemainder)
+	{
+		ullBit >>= 2;
+	}
+
+	// Work out the root a bit at a time
+	while (ullBit != 0)
+	{
+		if (ullRemainder >= ullRoot + ullBit)
+		{
+			ullRemainder -= ullRoot + ullBit;
+			ullRoot = (ullRoot >> 1) + ullBit;
+		}
+		else
+		{
+			ullRoot >>= 1;
+		}
+		ullBit >>= 2;
+	}
+
+	return (unsigned long)ullRoot;
+}
+
+/******************************************************************************
+ * Works out where the next sweep segment ends, and how much the step must
+ * change each sample to get there. Called once per segment by the renderer.
+ ******************************************************************************/
+static void StartSegment(void)
+{
+	long long llDelta;
+
+	++ucSegment;
+	ulSegmentLeft = Sweep.ulSegmentLength;
+
+	if (ucSegment == SWEEP_SEGMENTS)
+	{	// Finish exactly on the stop frequency
+		ulSegmentEnd = Sweep.ulStopStep;
+	}
+	else if (Sweep.Type == SWEEP_LINEAR)
+	{
+		ulSegmentEnd = Sweep.ulStartStep + (unsigned long)
+			((((long long)Sweep.ulStopStep - (long long)Sweep.ulStartStep) *
+			  ucSegment) >> SWEEP_SEGMENT_BITS);
+	}
+	else
+	{
+		ulSegmentEnd = (unsigned long)
+			(((unsigned long long)ulSegmentEnd * Sweep.ulRatio) >> 16);
+	}
+
+	// Change per sample, in 1/65536ths, split into whole and fraction
+	llDelta = (((long long)ulSegmentEnd - (long long)ulSweepStep) << 16) /
+			  (long)ulSegmentLeft;
+	lSweepDelta = (long)(llDelta >> 16);
+	uiSweepDeltaFrac = (unsigned int)(llDelta & 0xFFFF);
+	uiSweepFracSum = 0;
+}
+
+/******************************************************************************
+ * Moves the sweep on by one sample, and returns the new tuning word for the
+ * main signal. Only adds are done, except at the end of a segment.
+ ******************************************************************************/
+static unsigned long AdvanceSweep(void)
+{
+	unsigned int uiFracSum = uiSweepFracSum + uiSweepDeltaFrac;
+
+	// Add the whole part, plus 1 whenever the fraction carries
+	ulSweepStep += lSweepDelta + (uiFracSum < uiSweepFracSum);
+	uiSweepFracSum = uiFracSum;
+
+	if (--ulSegmentLeft == 0)
+	{	// Land exactly on the end of the segment
+		ulSweepStep = ulSegmentEnd;
+
+		if (ucSegment == SWEEP_SEGMENTS)
+		{	// Sweep is complete
+			bSweepActive = FALSE;
+		}
+		else
+		{
+			StartSegment();
+		}
+	}
+
+	return ulSweepStep;
+}
+
+/******************************************************************************
+ * Commits a new gain, if one has been published, either straight away or
+ * as a ramp over ucRampPeriods periods of the main signal. Called by the
+ * renderer at the bottom of the main signal's period.
+ ******************************************************************************/
+static void CommitGain(void)
+{
+	unsigned char ucCount;
+	unsigned int uiGain;
+
+	// Read the gain again if it was changed while we were reading it
+	do
+	{
+		ucCount = ucGainCount;
+		uiGain = VoltageGain[ucActiveVoltArray];
+	} while (ucCount != ucGainCount);
+
+	if (ucCount != ucGainCountSeen)
+	{	// There's a new gain
+		ucGainCountSeen = ucCount;
+		uiRampTarget = uiGain;
+
+		if ((ucRampPeriods == 0) || (ulMainStep == 0))
+		{	// Step straight to it
+			ulRampLeft = 0;
+			lRampGain = (long)uiGain << GAIN_RAMP_BITS;
+		}
+		else
+		{	// Samples per period is 2^32 / tuning word
+			ulRampLeft = (0xFFFFFFFFUL / ulMainStep) * ucRampPeriods;
+			lRampStep = (((long)uiGain << GAIN_RAMP_BITS) - lRampGain) /
+						(long)ulRampLeft;
+		}
+	}
+}
+
+#if defined (SIGNAL_DITHER)
+/******************************************************************************
+ * Cuts a scaled sample, as the renderer makes it, to a D/A code, adding
+ * dither and the error left from the last sample of the same D/A. Returns
+ * the FIFO entry for the code. With D2A_CALIBRATION it's CalibrateBlock
+ * that calls this, once the sample has been corrected.
+ *
+ * The random numbers come from a 16-bit xorshift generator. This is an
+ * LFSR that steps all 16 bits at once, so each call gets two fresh bytes
+ * for a few shifts and exclusive-ors. The whole thing is straight-line code
+ * apart from the clamps, and is counted in SAMPLE_CYCLES.
+ ******************************************************************************/
+static inline unsigned int DitherSample(unsigned long ulScaled, long *plCarry)
+{
+	unsigned int uiRandom = uiDitherRandom;
+	long lValue, lCode;
+
+	uiRandom ^= uiRandom << 7;
+	uiRandom ^= uiRandom >> 9;
+	uiRandom ^= uiRandom << 8;
+	uiDitherRandom = uiRandom;
+
+	// Sample, with DITHER_FRAC_BITS of fraction, less the last error
+	lValue = (long)(ulScaled >> DITHER_SHIFT) + *plCarry;
+	lCode = (lValue + (uiRandom & 0xFF) + (uiRandom >> 8) - DITHER_MEAN) >>
+			DITHER_FRAC_BITS;
+
+	if (lCode < 0)
+	{	// Past the end of the D/A. Don't carry the error, or it builds up.
+		lCode = 0;
+		*plCarry = 0;
+	}
+	else if (lCode > (long)D2A_FULL_SCALE)
+	{
+		lCode = D2A_FULL_SCALE;
+		*plCarry = 0;
+	}
+	else
+	{
+		*plCarry = lValue - (lCode << DITHER_FRAC_BITS);
+	}
+
+	return (unsigned int)lCode << FIFO_SHIFT;
+}
+#endif
+
+/******************************************************************************
+ * Returns the sine wave at the given phase (upper 16 bits of the phase
+ * accumulator), as an offset binary value from 1 to 65535.
+ *
+ * Only a quarter period is stored. The second and fourth quadrants read the
+ * table backwards, and the third and fourth quadrants are negated. Both are
+ * done with masks rather than branches, so every phase takes the same time.
+ ******************************************************************************/
+static inline unsigned int SineSample(unsigned int uiPhase)
+{
+	unsigned char ucQuadrant = (unsigned char)(uiPhase >> 14);
+	unsigned int uiIndex, uiNegate, uiValue;
+
+	uiIndex = (uiPhase >> PHASE_INDEX_SHIFT) & (QUARTER_TABLE_SIZE - 1);
+	uiIndex ^= (-(unsigned int)(ucQuadrant & 1)) & (QUARTER_TABLE_SIZE - 1);
+	uiNegate = -(unsigned int)(ucQuadrant >> 1);
+
+	uiValue = pgm_read_word(&SineQuarter[uiIndex]);
+
+	return 0x8000 + ((uiValue ^ uiNegate) - uiNegate);
+}
+
+/******************************************************************************
+ * Waveform generators. Each takes the 32-bit phase accumulator and returns
+ * the waveform at that phase as an offset binary value, with mid-scale at
+ * 0x8000. Every waveform starts at mid-scale and rises, like the sine. None
+ * of them branch on the phase.
+ ******************************************************************************/
+/* The sine is looked up in the quarter-wave table. The bits below the index
+ * are the fractional phase, which is used to interpolate towards the next
+ * table entry when DDS_INTERPOLATE is defined. */
+static unsigned int SineWave(unsigned long ulPhase)
+{
+	unsigned int uiPhase = (unsigned int)(ulPhase >> 16);
+	unsigned int uiSine = SineSample(uiPhase);
+#if defined (DDS_INTERPOLATE)
+	unsigned char ucFraction;
+	int iDelta;
+
+	ucFraction = (unsigned char)(ulPhase >> (16 + PHASE_INDEX_SHIFT - 8));
+	iDelta = (int)(SineSample(uiPhase + (1 << PHASE_INDEX_SHIFT)) - uiSine);
+	uiSine += (int)(((long)iDelta * ucFraction) >> 8);
+#endif
+
+	return uiSine;
+}
+
+/* High for the first half period, low for the second */
+static unsigned int SquareWave(unsigned long ulPhase)
+{
+	return ((unsigned int)(ulPhase >> 31) - 1) | 1;
+}
+
+/* Shifting the phase by a quarter period puts the peak at bit 15. Doubling
+ * gives the ramp, and inverting it in the second half folds it back down. */
+static unsigned int TriangleWave(unsigned long ulPhase)
+{
+	unsigned int uiPhase = (unsigned int)(ulPhase >> 16) + 0x4000;
+
+	return (unsigned int)(uiPhase << 1) ^ -(uiPhase >> 15);
+}
+
+static unsigned int SawtoothWave(unsigned long ulPhase)
+{
+	return (unsigned int)(ulPhase >> 16) ^ 0x8000;
+}
+
+static unsigned int UserWave(unsigned long ulPhase)
+{
+	return UserWaveTable[(unsigned int)(ulPhase >> (32 - USER_WAVE_BITS))];
+}
+
+/* Indexed by eWaveformType */
+static unsigned int (* const WaveformFuncs[NUM_WAVEFORMS])(unsigned long) = {
+	SineWave,
+	SquareWave,
+	TriangleWave,
+	SawtoothWave,
+	UserWave
+};
+
+/******************************************************************************
+ * Renders the next ucCount waveform values into pBuffer, as D/A counts (or
+ * frames, with D2A_PREENCODE).
+ *
+ * The signal is generated by direct digital synthesis: each voice's tuning
+ * word is added to its 32-bit phase accumulator every sample, and the
+ * accumulator plus the voice's phase offset is passed to the selected
+ * waveform generator. The voices are weighted by their levels and summed,
+ * the sum is clipped to the output range, and then scaled by the voltage
+ * gain.
+ *
+ * When modulation is on, a low-rate sine is stepped along with the voices.
+ * FM adds it, times the deviation, to the main signal's tuning word. AM
+ * turns it into a level from 1 - depth to 1, which the mix is multiplied by.
+ * Both are a multiply and an add per sample.
+ *
+ * This runs in the foreground. The voices, gain and waveform are read once
+ * for the whole block, so a block is always rendered with one set of
+ * parameters. The inner loop is the same for every voice.
+ ******************************************************************************/
+void RenderSamples(unsigned int *pBuffer, unsigned char ucCount)
+{
+	VoiceType Voice[MIXER_VOICES];
+	ModulationType Mod;
+	unsigned char i, ucVoices;
+	unsigned int uiGain, uiWave, uiAmLevel;
+	unsigned long ulNewStep;
+	int iMod;
+	long lMix;
+	unsigned int (*pWaveform)(unsigned long);
+
+	if (ucSweepCommand != SWEEP_IDLE)
+	{	// Pick up a change to the sweep
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			bSweepActive = (ucSweepCommand == SWEEP_START) ? TRUE : FALSE;
+			Sweep = SweepRequest;
+			ucSweepCommand = SWEEP_IDLE;
+		}
+
+		if (bSweepActive == TRUE)
+		{
+			ulSweepStep = Sweep.ulStartStep;
+			ulSegmentEnd = Sweep.ulStartStep;
+			ucSegment = 0;
+			StartSegment();
+			ulSweepTotal = Sweep.ulSegmentLength << SWEEP_SEGMENT_BITS;
+		}
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ucVoices = ucNumVoices;
+		for (i = 0; i < ucVoices; i++)
+		{
+			Voice[i].ulStep = Voices[i].ulStep;
+			Voice[i].ulOffset = Voices[i].ulOffset;
+			Voice[i].uiLevel = Voices[i].uiLevel;
+		}
+		Mod.ulStep = Modulation.ulStep;
+		Mod.uiAmDepth = Modulation.uiAmDepth;
+		Mod.uiFmDeviation = Modulation.uiFmDeviation;
+	}
+	pWaveform = WaveformFuncs[Waveform];
+	ulNewStep = Voice[0].ulStep;
+	uiGain = (unsigned int)(lRampGain >> GAIN_RAMP_BITS);
+	iMod = 0;
+
+	while (ucCount-- != 0)
+	{
+		if (bSweepActive == TRUE)
+		{	// The sweep sets the main signal's frequency
+			ulMainStep = AdvanceSweep();
+		}
+
+		if (Mod.ulStep != 0)
+		{	// Step the modulating sine, -32768 to 32767
+			ulModPhase += Mod.ulStep;
+			iMod = (int)(SineSample((unsigned int)(ulModPhase >> 16)) - 0x8000);
+		}
+
+		// FM. Deviation is 0 when FM is off.
+		Voice[0].ulStep = ulMainStep + ((long)Mod.uiFmDeviation * iMod);
+
+		// Advance each voice, and sum the waveforms at those points
+		lMix = 0;
+		for (i = 0; i < ucVoices; i++)
+		{
+			VoicePhase[i] += Voice[i].ulStep;
+			uiWave = pWaveform(VoicePhase[i] + Voice[i].ulOffset);
+			lMix += ((long)(int)(uiWave - 0x8000) * Voice[i].uiLevel) >>
+					MIX_SHIFT;
+		}
+
+		/* A new frequency is committed at the end of the main signal's
+		 * period, and a new amplitude at the bottom of it. The first ones
+		 * are committed straight away, since there's no signal to upset. */
+		if ((VoicePhase[0] < Voice[0].ulStep) || (ulMainStep == 0))
+		{
+			if (bSweepActive == FALSE)
+			{
+				ulMainStep = ulNewStep;
+			}
+		}
+		if (((VoicePhase[0] - AMPLITUDE_COMMIT_PHASE) < Voice[0].ulStep) ||
+			(lRampGain == 0))
+		{
+			CommitGain();
+			uiGain = (unsigned int)(lRampGain >> GAIN_RAMP_BITS);
+		}
+
+		if (ulRampLeft != 0)
+		{	// Ramping to a new amplitude
+			lRampGain = (--ulRampLeft == 0) ?
+				((long)uiRampTarget << GAIN_RAMP_BITS) : (lRampGain + lRampStep);
+			uiGain = (unsigned int)(lRampGain >> GAIN_RAMP_BITS);
+		}
+
+		// Back to a 16-bit value, clipped to the output range
+		lMix >>= 15 - MIX_SHIFT;
+		if (lMix > 32767)
+		{
+			lMix = 32767;
+		}
+		else if (lMix < -32768)
+		{
+			lMix = -32768;
+		}
+
+		// AM. Depth is 0 when AM is off, which leaves the level at 1.
+		uiAmLevel = 0x8000 - Mod.uiAmDepth +
+					(int)(((long)Mod.uiAmDepth * iMod) >> 15);
+		lMix = (lMix * uiAmLevel) >> 15;
+		uiWave = (unsigned int)lMix + 0x8000;
+
+		/* Scale to the output voltage, rounding to the nearest D/A count,
+		 * or with calibration to the fraction CalibrateBlock rounds from */
+#if defined (SIGNAL_DITHER) && !defined (D2A_CALIBRATION)
+		*pBuffer++ = DitherSample((unsigned long)uiWave * uiGain,
+								  &DitherCarry[0]);
+#else
+		*pBuffer++ = (unsigned int)(((unsigned long)uiWave * uiGain +
+									 RENDER_ROUND) >> RENDER_SHIFT);
+#endif
+	}
+
+	// Publish how far through the sweep we are
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ulSweepRemaining = (bSweepActive == TRUE) ?
+			(((unsigned long)(SWEEP_SEGMENTS - ucSegment) * Sweep.ulSegmentLength) +
+			 ulSegmentLeft) : 0;
+	}
+}
+
+#if (D2A_CHANNELS > 1)
+/******************************************************************************
+ * Renders the next ucCount samples for one of the extra D/A channels into
+ * pBuffer, in the same form as RenderSamples.
+ ******************************************************************************/
+static void RenderChannel(unsigned char ucChannel, unsigned int *pBuffer,
+						  unsigned char ucCount)
+{
+	ChannelType Channel;
+	unsigned long ulPhase = ChannelPhase[ucChannel - 1];
+	unsigned int (*pWaveform)(unsigned long);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		Channel.ulStep = Channels[ucChannel - 1].ulStep;
+		Channel.uiGain = Channels[ucChannel - 1].uiGain;
+		Channel.ucWaveform = Channels[ucChannel - 1].ucWaveform;
+	}
+	pWaveform = WaveformFuncs[Channel.ucWaveform];
+
+	while (ucCount-- != 0)
+	{
+		ulPhase += Channel.ulStep;
+#if defined (SIGNAL_DITHER) && !defined (D2A_CALIBRATION)
+		*pBuffer++ = DitherSample((unsigned long)pWaveform(ulPhase) *
+								  Channel.uiGain, &DitherCarry[ucChannel]);
+#else
+		*pBuffer++ = (unsigned int)(((unsigned long)pWaveform(ulPhase) *
+									 Channel.uiGain + RENDER_ROUND) >>
+									RENDER_SHIFT);
+#endif
+	}
+
+	ChannelPhase[ucChannel - 1] = ulPhase;
+}
+#endif /* D2A_CHANNELS > 1 */
+
+/******************************************************************************
+ * Keeps the sample FIFO topped up. Called from the foreground loop.
+ *
+ * Samples are rendered in blocks of at least SAMPLE_BLOCK_SIZE, straight into
+ * the FIFO. The head index is only moved once a block is complete, so the
+ * ISR never pops a sample that hasn't been written yet.
+ ******************************************************************************/
+void ServiceSignal(void)
+{
+	unsigned char ucHead = ucSampleHead;
+	unsigned char ucFree, ucCount;
+#if (D2A_CHANNELS > 1)
+	unsigned char ucChannel;
+#endif
+#if defined (SIGNAL_CAPTURE)
+	unsigned int uiStart, uiCycles, uiCount;
+	unsigned char i;
+#endif
+
+	/* One entry is always left empty, so that a full FIFO can be told apart
+	 * from an empty one. */
+	ucFree = (ucSampleTail - ucHead - 1) & (SAMPLE_FIFO_SIZE - 1);
+
+	while (ucFree >= SAMPLE_BLOCK_SIZE)
+	{
+		PROFILE_ENTER(PROFILE_RENDER);
+
+		// Render up to the end of the buffer; the rest on the next pass
+		ucCount = SAMPLE_FIFO_SIZE - ucHead;
+		if (ucCount > ucFree)
+		{
+			ucCount = ucFree;
+		}
+
+#if defined (SIGNAL_CAPTURE)
+		uiStart = TCNT3;
+#endif
+		RenderSamples(&SampleFifo[ucHead], ucCount);
+#if defined (D2A_CALIBRATION)
+		CalibrateBlock(0, &SampleFifo[ucHead], ucCount);
+#endif
+#if (D2A_CHANNELS > 1)
+		for (ucChannel = 1; ucChannel < D2A_CHANNELS; ucChannel++)
+		{
+			RenderChannel(ucChannel, &ChannelFifo[ucChannel - 1][ucHead], ucCount);
+#if defined (D2A_CALIBRATION)
+			CalibrateBlock(ucChannel, &ChannelFifo[ucChannel - 1][ucHead],
+						   ucCount);
+#endif
+		}
+#endif
+#if defined (SIGNAL_CAPTURE)
+		uiCycles = TCNT3 - uiStart;
+
+		uiCount = uiCaptureCount;
+		if (uiCount < CAPTURE_SIZE)
+		{	// Keep as much of the block as fits, but time all of it
+			ulCaptureCycles += uiCycles;
+			uiCaptureTimed += ucCount;
+			for (i = 0; (i < ucCount) && (uiCount < CAPTURE_SIZE); i++)
+			{
+				CaptureBuffer[uiCount++] = SampleFifo[ucHead + i] >> FIFO_SHIFT;
+			}
+			uiCaptureCount = uiCount;
+		}
+#endif
+
+		ucHead = (ucHead + ucCount) & (SAMPLE_FIFO_SIZE - 1);
+		ucSampleHead = ucHead;
+		ucFree -= ucCount;
+
+		PROFILE_EXIT(PROFILE_RENDER);
+	}
+}
+
+#if defined (SIGNAL_CAPTURE)
+/******************************************************************************
+ * Starts capturing the D/A codes being rendered. The time spent rendering is
+ * measured with Timer 3, and includes any interrupts taken while rendering.
+ ******************************************************************************/
+void StartCapture(void)
+{
+	// Timer 3 free-runs at F_CPU, normal mode
+	TCCR3A = 0;
+	TCCR3B = _BV(CS30);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ulCaptureCycles = 0;
+		uiCaptureTimed = 0;
+		uiCaptureCount = 0;
+	}
+}
+
+/******************************************************************************
+ * Returns TRUE once a capture is complete, with a pointer to the samples
+ * (CAPTURE_SIZE D/A codes) and the average clocks taken to render each one.
+ ******************************************************************************/
+eBooleanType GetCapture(const unsigned int **ppSamples,
+						unsigned int *puiCyclesPerSample)
+{
+	eBooleanType bReady = FALSE;
+
+	if (uiCaptureCount == CAPTURE_SIZE)
+	{
+		*ppSamples = CaptureBuffer;
+		*puiCyclesPerSample = (unsigned int)(ulCaptureCycles / uiCaptureTimed);
+		bReady = TRUE;
+	}
+
+	return bReady;
+}
+#endif /* SIGNAL_CAPTURE */
+
+/******************************************************************************
+ * Returns the number of times the sample ISR has found the FIFO empty.
+ ******************************************************************************/
+unsigned int GetSampleUnderruns(void)
+{
+	unsigned int uiCount;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uiCount = uiSampleUnderruns;
+	}
+
+	return uiCount;
+}
+
+/******************************************************************************
+ * Takes the next sample off the FIFO, and makes the frames UpdateSignal will
+ * write next. If the foreground has fallen behind, the last frames are kept,
+ * so the last sample is repeated, and the underrun is counted.
+ ******************************************************************************/
+static void LoadOutputFrames(void)
+{
+	unsigned char ucTail = ucSampleTail;
+#if (D2A_CHANNELS > 1)
+	unsigned char i;
+#endif
+
+	if (ucTail != ucSampleHead)
+	{
+		uiOutputValue = SampleFifo[ucTail];
+		OutputFrames[0] = FIFO_FRAME(uiOutputValue);
+#if (D2A_CHANNELS > 1)
+		for (i = 1; i < D2A_CHANNELS; i++)
+		{
+			OutputFrames[i] = FIFO_FRAME(ChannelFifo[i - 1][ucTail]);
+		}
+#endif
+		ucSampleTail = (ucTail + 1) & (SAMPLE_FIFO_SIZE - 1);
+	}
+	else
+	{
+		++uiSampleUnderruns;
+	}
+}
+
+/******************************************************************************
+ * This file outputs the next sine wave value.
+ *
+ * Previous sine wave value is output first to reduce any errors in variance of
+ * execution time of this function.
+ * 
+ * Since we want to minimize the time in this function, no error checking or
+ * other "niceties" are done.
+ *
+ * The samples are rendered ahead of time by ServiceSignal. The frames made
+ * on the last run are written before anything else, down a path with no
+ * branches that depend on the data, so the D/A is always loaded the same
+ * number of clocks after the interrupt. Only then is the next sample popped
+ * from the FIFO (see LoadOutputFrames), whichever way that goes.
+ ******************************************************************************/
+void UpdateSignal( )
+{
+#if defined (SLOW_SINE)
+	unsigned int uiWritten;
+#endif
+	PROFILE_ENTER(PROFILE_SIGNAL);
+
+#if (D2A_CHANNELS > 1)
+	// Every channel in one burst, so the skew between them stays fixed
+	WriteDtoABurst(OutputFrames, D2A_CHANNELS);
+#else
+	WriteDtoAFrame(OutputFrames[0]);
+#endif
+
+#if defined (SLOW_SINE)
+	// The sample just written, before the next one replaces it
+	uiWritten = uiOutputValue >> FIFO_SHIFT;
+#endif
+
+	LoadOutputFrames();
+
+#if defined (SLOW_SINE)
+	/* The serial port belongs to the foreground, so hand the sample over for
+	 * main to print. Samples are skipped while one is still waiting. */
+	if ( DisplaySamples && (bSamplePending == FALSE) )
+	{
+		uiShownSample = uiWritten;
+		bSamplePending = TRUE;
+		PostEvent(EVENT_SHOW_SAMPLE);
+	}
+#endif
+
+	PROFILE_EXIT(PROFILE_SIGNAL);
+}  // End of UpdateSignal
+
+#if defined (SLOW_SINE)
+/******************************************************************************
+ * Prints the sample handed over by UpdateSignal. Called from the foreground.
+ ******************************************************************************/
+void ShowSample(void)
+{
+    unsigned int uiValue = uiShownSample;
+    char DebugStr[6];
+    char *pDebugStr = &DebugStr[sizeof(DebugStr) - 1];
+
+	/* Codes go up to 65535, past what _itoa's int can hold, so they are
+	 * converted here as unsigned, last digit first. */
+	*pDebugStr = '\0';
+	do
+	{
+		*--pDebugStr = '0' + (uiValue % 10);
+		uiValue /= 10;
+	} while (uiValue != 0);
+
+	SCIWriteString("Sample  = ");
+	SCIWriteString(pDebugStr);
+	SCIWriteString("\r\n");
+	bSamplePending = FALSE;
+}
+#endif
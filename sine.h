@@ -7,29 +7,164 @@
  *  Date	Changed by:	Changes:
  * -------	-----------	-------------------------------------------------------
  * 30Apr02	R Weber		Initial File
+ * 16Oct26	agent		Added the build options and interface for the above.
  ******************************************************************************/
 #if !defined(SINE_H)		/* Prevents including this file multiple times */
 #define SINE_H
 
 #include "errors.h"
+#include "lib.h"
+#include "dtoa.h"
 
 /* Number of samples per period of the Output signal */
-#define SAMPLES_PER_PERIOD		100
+#if !defined (SAMPLES_PER_PERIOD)
+#define SAMPLES_PER_PERIOD		1024
+#endif
+
+/* Samples are written to the D/A at a rate chosen by the planner for each
+ * frequency. It aims for a full table's worth of samples per period, but
+ * never goes above MAX_SAMPLE_RATE, which is set by the share of the CPU
+ * the signal may use (SIGNAL_CPU_BUDGET percent) and the clocks it takes to
+ * render and output one sample (SAMPLE_CYCLES) on each D/A channel. Each
+ * byte of the D/A frame costs an SPI interrupt, and SIGNAL_DITHER adds
+ * DITHER_CYCLES to each sample. MIN_SAMPLE_RATE keeps the modulation and
+ * FIFO latency reasonable for very low frequencies.
+ * With SLOW_SINE, samples are clocked by the medium thread instead, so the
+ * rate is fixed and the signal plays back 100 times slower than requested. */
+#define SIGNAL_CPU_BUDGET		50		// percent
+
+/* SAMPLE_CYCLES is a budget worked out from the code, not a measurement.
+ * It has not been checked against a cycle count on the target, and nor has
+ * DITHER_CYCLES, the share of it for the dither. */
+#if defined (SIGNAL_DITHER)
+#define DITHER_CYCLES			50
+#else
+#define DITHER_CYCLES			0
+#endif
+#define SAMPLE_CYCLES			(340 + 30 * D2A_FRAME_BYTES + DITHER_CYCLES)
+
+#if defined (SLOW_SINE)
+#define MAX_SAMPLE_RATE			4000UL
+#define MIN_SAMPLE_RATE			MAX_SAMPLE_RATE
+#else
+#define CPU_SAMPLE_RATE			((F_CPU / 100 * SIGNAL_CPU_BUDGET) /	\
+								 (SAMPLE_CYCLES * D2A_CHANNELS))
+/* A PWM output can't change faster than its carrier */
+#if defined (D2A_PWM) && (D2A_PWM_CARRIER < CPU_SAMPLE_RATE)
+#define MAX_SAMPLE_RATE			D2A_PWM_CARRIER
+#else
+#define MAX_SAMPLE_RATE			CPU_SAMPLE_RATE
+#endif
+#define MIN_SAMPLE_RATE			500UL
+#endif
+
+/* With SIGNAL_CAPTURE, this many D/A codes can be captured from the output
+ * stream, along with the time taken to render them, so the spectral purity
+ * and cost of a build can be measured. */
+#define CAPTURE_SIZE			512
+
+/* Frequencies of the main signal are in tenths of a Hz */
+#define FREQ_SCALE				10
+
+/* The top frequency is kept well below half the highest sample rate, so
+ * there are always 3 or more samples per period. */
+#define MAX_FREQUENCY			((MAX_SAMPLE_RATE * 3 < 30000) ?	\
+								 (MAX_SAMPLE_RATE * 3) : 30000)	// 3000.0 Hz
+#define MIN_FREQUENCY			1								//    0.1 Hz
+
+/* Extra voices are set in whole Hz, up to half the highest sample rate */
+#define MAX_VOICE_FREQUENCY		((MAX_SAMPLE_RATE / 2 < 6000) ?		\
+								 (MAX_SAMPLE_RATE / 2) : 6000)
+
+/* Number of points in the user-defined waveform. Must be a power of two. */
+#define USER_WAVE_BITS			6
+#define USER_WAVE_SIZE			(1 << USER_WAVE_BITS)
+
+/* Number of oscillators that can be mixed into the output. Voice 0 is the
+ * main signal. */
+#define MIXER_VOICES			4
+
+/* Waveforms that can be output */
+typedef enum {
+    WAVE_SINE,
+    WAVE_SQUARE,
+    WAVE_TRIANGLE,
+    WAVE_SAWTOOTH,
+    WAVE_USER,
+    NUM_WAVEFORMS
+} eWaveformType;
+
+/* Ways the frequency can be swept */
+typedef enum {
+    SWEEP_LINEAR,
+    SWEEP_LOG
+} eSweepType;
+
+/* Ways the output can be modulated */
+typedef enum {
+    MOD_NONE,
+    MOD_AM,
+    MOD_FM
+} eModulationType;
 
 /******************************************************************************
  * Define Macros for getting the desired or actual voltage or frequency.
  ******************************************************************************/
-extern volatile unsigned int FreqDesired, VoltDesired, FreqActual, VoltActual;
+/* FreqDesired is in tenths of a Hz (FREQ_SCALE) */
+extern volatile unsigned int FreqDesired, VoltDesired, VoltActual;
+extern volatile unsigned long FreqActual;
+
+/* FreqActual is reported in hundredths of a Hz */
+#define FREQ_ACTUAL_SCALE       100
+
 #define GET_FREQ_DESIRED()      FreqDesired
 #define GET_VOLT_DESIRED()      VoltDesired
 #define GET_FREQ_ACTUAL()       FreqActual
 #define GET_VOLT_ACTUAL()       VoltActual
 
+/* Sample rate and Timer 1 settings chosen for the present frequency */
+typedef struct
+{
+    unsigned long ulSampleRate;         /* Samples per second */
+    unsigned int  uiPrescaler;          /* Timer 1 clock prescaler */
+    unsigned int  uiTimerCount;         /* OCR1A, one less than clocks/sample */
+    unsigned int  uiTimerFrac;          /* plus this many 1/65536ths of a clock */
+    unsigned long ulSamplesPerPeriod;   /* Of the main signal */
+} SignalPlanType;
+
+extern volatile unsigned char Waveform;
+#define GET_WAVEFORM()          Waveform
+
 // Access functions for sine wave
 eErrorType SetFreq(unsigned int);
 eErrorType SetVolt(unsigned int);
+eErrorType SetVoice(unsigned char, unsigned int, unsigned int, unsigned int);
+#if (D2A_CHANNELS > 1)
+eErrorType SetChannel(unsigned char, unsigned int, unsigned int, eWaveformType);
+#endif
+eErrorType StartSweep(unsigned int, unsigned int, unsigned int, eSweepType);
+unsigned char GetSweepProgress(void);
+eErrorType SetModulation(eModulationType, unsigned int, unsigned int);
+void SetRampPeriods(unsigned char);
+void GetSignalPlan(SignalPlanType *);
+#if defined (SIGNAL_CAPTURE)
+void StartCapture(void);
+eBooleanType GetCapture(const unsigned int **, unsigned int *);
+#endif
+#if defined (D2A_CALIBRATION)
+eErrorType SetCalibration(unsigned char, const D2ACalType *);
+void GetCalibration(unsigned char, D2ACalType *);
+#endif
+eErrorType SetWaveform(eWaveformType);
+eErrorType SetUserWavePoint(unsigned char, unsigned int);
 void initSine(void);
 void CalcSineValues(unsigned int);
+void RenderSamples(unsigned int *, unsigned char);
+void ServiceSignal(void);
+unsigned int GetSampleUnderruns(void);
 void UpdateSignal(void);
+#if defined (SLOW_SINE)
+void ShowSample(void);
+#endif
 
 #endif
@@ -0,0 +1,152 @@
+/******************************************************************************
+ * File Name:	host.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Stands in for the hardware and the rest of the firmware, so
+ *				sine.c can be run on the host. D/A writes are captured as
+ *				codes, and Timer 1 settings are kept so the real sample rate
+ *				can be worked out.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <avr/io.h>
+
+#include "lib.h"
+#include "dtoa.h"
+#include "sine.h"
+#include "host.h"
+
+#define REG8(name)		volatile uint8_t name;
+#define REG16(name)		volatile uint16_t name;
+#include <avr/regs.h>
+
+int DisplaySamples;
+unsigned long HostCodes;
+
+static uint16_t *pCodes;
+static unsigned long ulCodesSize;
+static uint8_t ucClockSelect = 1;
+static uint16_t uiCount, uiFrac;
+
+/******************************************************************************
+ * D/A
+ ******************************************************************************/
+void HostCapture(uint16_t *pBuffer, unsigned long ulSize)
+{
+	pCodes = pBuffer;
+	ulCodesSize = ulSize;
+	HostCodes = 0;
+}
+
+static void Capture(uint16_t uiFrame)
+{
+	if ((pCodes != NULL) && (HostCodes < ulCodesSize))
+	{
+		pCodes[HostCodes++] = (uint16_t)(uiFrame & ~D2A_FRAME_COMMAND) >>
+							  D2A_FRAME_SHIFT;
+	}
+}
+
+void InitDtoA(void)
+{
+}
+
+void WriteDtoASample(uint16_t uiValue)
+{
+	Capture(D2A_FRAME(uiValue));
+}
+
+void WriteDtoAFrame(uint16_t uiFrame)
+{
+	Capture(uiFrame);
+}
+
+/* Only channel 0 is captured */
+void WriteDtoABurst(const uint16_t *pFrames, uint8_t ucCount)
+{
+	(void)ucCount;
+	Capture(pFrames[0]);
+}
+
+void DtoAByteSent(void)
+{
+}
+
+void GetDtoAStats(D2AStatsType *pStats)
+{
+	memset(pStats, 0, sizeof(*pStats));
+}
+
+#if defined (D2A_CALIBRATION)
+/* The calibration "EEPROM". Tests fill it in before initSine. */
+D2ACalType HostCal[D2A_CHANNELS];
+eBooleanType HostCalValid;
+
+eBooleanType ReadDtoACal(uint8_t ucChannel, D2ACalType *pCal)
+{
+	if (HostCalValid == FALSE)
+	{
+		memset(pCal, 0, sizeof(*pCal));
+		return FALSE;
+	}
+	*pCal = HostCal[ucChannel];
+	return TRUE;
+}
+
+void WriteDtoACal(uint8_t ucChannel, const D2ACalType *pCal)
+{
+	HostCal[ucChannel] = *pCal;
+	HostCalValid = TRUE;
+}
+#endif
+
+/******************************************************************************
+ * Timer 1
+ ******************************************************************************/
+/* Weak, so a test can link the real one from interrpt.c instead */
+__attribute__((weak)) void SetTimer1Period(uint8_t ucNewClockSelect,
+										   uint16_t uiNewCount,
+										   uint16_t uiNewFrac)
+{
+	ucClockSelect = ucNewClockSelect;
+	uiCount = uiNewCount;
+	uiFrac = uiNewFrac;
+}
+
+double HostSampleRate(void)
+{
+	static const double Prescalers[] = {1, 8, 64, 256, 1024};
+
+	return (double)F_CPU / (Prescalers[ucClockSelect - 1] *
+							(uiCount + 1 + uiFrac / 65536.0));
+}
+
+/******************************************************************************
+ * Running the signal
+ ******************************************************************************/
+void HostRun(unsigned long ulSamples)
+{
+	while (ulSamples-- != 0)
+	{
+		ServiceSignal();
+		UpdateSignal();
+	}
+}
+
+double HostNsPerSample(unsigned long ulSamples)
+{
+	struct timespec Start, End;
+
+	clock_gettime(CLOCK_MONOTONIC, &Start);
+	HostRun(ulSamples);
+	clock_gettime(CLOCK_MONOTONIC, &End);
+
+	return ((End.tv_sec - Start.tv_sec) * 1e9 +
+			(End.tv_nsec - Start.tv_nsec)) / ulSamples;
+}
@@ -0,0 +1,32 @@
+/******************************************************************************
+ * File Name:	host.h
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		What the host stand-ins for the rest of the firmware give
+ *				the tests: the D/A codes written, and the sample rate.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#if !defined(HOST_H)
+#define HOST_H
+
+#include <stdint.h>
+
+/* Codes written to the D/A, from HostCapture on, up to the size given.
+ * HostCodes counts them. */
+void HostCapture(uint16_t *, unsigned long);
+extern unsigned long HostCodes;
+
+/* Runs the foreground and the sample ISR for a number of samples */
+void HostRun(unsigned long);
+
+/* Exact average sample rate Timer 1 was last set to, in Hz */
+double HostSampleRate(void);
+
+/* Nanoseconds of host time per sample, to compare builds. This is not a
+ * target cycle count. */
+double HostNsPerSample(unsigned long);
+
+#endif /* HOST_H */
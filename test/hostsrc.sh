@@ -0,0 +1,19 @@
+#!/bin/sh
+# Copies the firmware sources into $1 with their integer types rewritten to
+# the widths avr-gcc gives them (16-bit int, 32-bit long), so the host tests
+# do the same arithmetic, and overflow in the same places, as the target.
+set -e
+out=$1
+mkdir -p "$out"
+for f in ../*.c ../*.h; do
+	sed -e 's/unsigned long long/uint64_t/g' \
+	    -e 's/long long/int64_t/g' \
+	    -e 's/unsigned long/uint32_t/g' \
+	    -e 's/\blong\b/int32_t/g' \
+	    -e 's/unsigned int/uint16_t/g' \
+	    -e 's/\bint\b/int16_t/g' \
+	    -e 's/int16_t main/int main/' \
+	    -e 's/\([0-9]\)UL\b/\1U/g' \
+	    -e '1i #include <stdint.h>' \
+	    "$f" > "$out/$(basename "$f")"
+done
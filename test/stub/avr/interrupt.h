@@ -0,0 +1,12 @@
+/* Host stand-in for <avr/interrupt.h> */
+#if !defined(STUB_AVR_INTERRUPT_H)
+#define STUB_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector, ...)	void vector(void); void vector(void)
+#define ISR_NOBLOCK
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,22 @@
+/* Host stand-in for <avr/io.h>: the registers the sources touch, as plain
+ * variables (defined in host.c), and the bit numbers they use. */
+#if !defined(STUB_AVR_IO_H)
+#define STUB_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit)		(1u << (bit))
+
+#define REG8(name)		extern volatile uint8_t name;
+#define REG16(name)		extern volatile uint16_t name;
+#include "regs.h"
+#undef REG8
+#undef REG16
+
+enum {
+	WGM00 = 0, WGM01 = 1, WGM02 = 3, CS00 = 0, CS01 = 1, CS02 = 2,
+	OCIE0A = 1, OCIE0B = 2, TOIE0 = 0,
+	OCIE1A = 1, WGM12 = 3, CS10 = 0, CS11 = 1, CS12 = 2
+};
+
+#endif
@@ -0,0 +1,9 @@
+/* Host stand-in for <avr/pgmspace.h>: program memory is just memory */
+#if !defined(STUB_AVR_PGMSPACE_H)
+#define STUB_AVR_PGMSPACE_H
+
+#define PROGMEM
+#define PGM_P				const char *
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+
+#endif
@@ -0,0 +1,5 @@
+/* Registers used by the sources. Included with REG8 and REG16 defined. */
+REG8(DDRB) REG8(PORTB) REG8(PINB)
+REG8(SPCR) REG8(SPDR) REG8(SPSR)
+REG8(TCCR0A) REG8(TCCR0B) REG8(OCR0A) REG8(OCR0B) REG8(TIMSK0) REG8(TCNT0)
+REG8(TCCR1A) REG8(TCCR1B) REG16(OCR1A) REG8(TIMSK1) REG16(TCNT1)
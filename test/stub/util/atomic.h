@@ -0,0 +1,9 @@
+/* Host stand-in for <util/atomic.h>. The host tests are single threaded. */
+#if !defined(STUB_UTIL_ATOMIC_H)
+#define STUB_UTIL_ATOMIC_H
+
+#define ATOMIC_RESTORESTATE		0
+#define ATOMIC_FORCEON			1
+#define ATOMIC_BLOCK(type)		for (int _atomic_once = 1; _atomic_once; _atomic_once = 0)
+
+#endif
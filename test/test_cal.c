@@ -0,0 +1,156 @@
+/******************************************************************************
+ * File Name:	test_cal.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Checks that a calibrated D/A makes each sample to within
+ *				1 LSB. The D/A is modelled with the errors its calibration
+ *				describes: code * (1 + gain error) + offset + INL(code),
+ *				with the INL a straight line between points. Each sample is
+ *				rendered twice from the same phase, once uncalibrated, which
+ *				gives the ideal value with its fraction, and once through the
+ *				calibration. sine.c is included, so it can be run that way.
+ *
+ *				A D/A that's low can need more gain than the renderer has
+ *				at the top voltages. The gain is then held at its limit, so
+ *				the ideal is scaled down to match, and the codes must still
+ *				be within 1 LSB of it rather than wrapping.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdio.h>
+#include <math.h>
+
+#include "sine.c"
+#include "host.h"
+
+#define SAMPLES				4096
+#define SETTLE_SAMPLES		20000UL
+#define MAX_ERROR_LSB		1.0
+
+static const D2ACalType Cals[] =
+{
+	{    0,     0, { 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+	{   -3,   150, { 0, 2, 4, 3, 0, -2, -4, -1, 0 } },
+	{   40,  -250, { 0, -6, -8, -3, 2, 8, 5, 1, 0 } },
+	{  -25,   700, { 0, 3, 7, 9, 6, 2, -3, -2, 0 } },
+	{   12, -1000, { 0, 1, -1, 2, -2, 1, -1, 0, 0 } },
+};
+
+static const unsigned int Volts[] = { 100, 250, 420, 500 };
+
+static uint16_t Ideal[SAMPLES];
+static uint16_t Codes[SAMPLES];
+
+/******************************************************************************
+ * Output of the modelled D/A for a code, in LSB
+ ******************************************************************************/
+static double DtoA(const D2ACalType *pCal, unsigned int uiCode)
+{
+	double dPoint = uiCode / ((D2A_FULL_SCALE + 1.0) /
+							  (1 << D2A_CAL_SEGMENT_BITS));
+	unsigned char ucPoint = (unsigned char)dPoint;
+
+	return uiCode * (1 + pCal->iGainError / (double)CAL_GAIN_ERROR_SCALE) +
+		   pCal->iOffset + pCal->scInl[ucPoint] +
+		   (pCal->scInl[ucPoint + 1] - pCal->scInl[ucPoint]) *
+		   (dPoint - ucPoint);
+}
+
+/******************************************************************************
+ * Sets the calibration and voltage, and renders the next SAMPLES samples
+ * from the given phase, once any change of gain is done.
+ ******************************************************************************/
+static void Render(const D2ACalType *pCal, unsigned int uiVolt,
+				   unsigned long ulPhase, uint16_t *pBuffer)
+{
+	unsigned long i;
+	unsigned char ucCount;
+
+	Calibrations[0] = *pCal;
+	BuildCalibration(0);
+	SetVolt(uiVolt);
+	for (i = 0; i < SETTLE_SAMPLES; i += SAMPLE_BLOCK_SIZE)
+	{
+		RenderSamples(pBuffer, SAMPLE_BLOCK_SIZE);
+	}
+
+	VoicePhase[0] = ulPhase;
+	for (i = 0; i < SAMPLES; i += ucCount)
+	{
+		ucCount = (SAMPLES - i > 255) ? 255 : (unsigned char)(SAMPLES - i);
+		RenderSamples(&pBuffer[i], ucCount);
+	}
+}
+
+int main(void)
+{
+	static const D2ACalType None;
+	unsigned char c, v;
+	unsigned int i;
+	double dIdeal, dLow, dHigh, dError, dWorst, dWorstAll = 0, dNeeded, dScale;
+	int iFailed = 0;
+
+	initSine();
+	SetFreq(1234);
+
+	for (c = 0; c < sizeof(Cals) / sizeof(Cals[0]); c++)
+	{
+		for (v = 0; v < sizeof(Volts) / sizeof(Volts[0]); v++)
+		{
+			// The uncalibrated render has the ideal value, with its fraction
+			Render(&None, Volts[v], 0x12345678UL, Ideal);
+			Render(&Cals[c], Volts[v], 0x12345678UL, Codes);
+			for (i = 0; i < SAMPLES; i += SAMPLE_BLOCK_SIZE)
+			{
+				CalibrateBlock(0, &Codes[i], SAMPLE_BLOCK_SIZE);
+			}
+
+			dNeeded = GainForVoltage(Volts[v]) /
+					  (1 + Cals[c].iGainError / (double)CAL_GAIN_ERROR_SCALE);
+			dScale = (dNeeded > RENDER_GAIN_MAX) ? RENDER_GAIN_MAX / dNeeded : 1;
+
+			// Where the D/A can't reach the ideal, it should be at its end
+			dLow = DtoA(&Cals[c], 0);
+			dHigh = DtoA(&Cals[c], D2A_FULL_SCALE);
+			dWorst = 0;
+			for (i = 0; i < SAMPLES; i++)
+			{
+				dIdeal = Ideal[i] * dScale / (1L << GAIN_FRAC_BITS);
+				if (dIdeal < dLow)
+				{
+					dError = (Codes[i] == 0) ? 0 : 99;
+				}
+				else if (dIdeal > dHigh)
+				{
+					dError = (Codes[i] >> FIFO_SHIFT == D2A_FULL_SCALE) ? 0 : 99;
+				}
+				else
+				{
+					dError = fabs(DtoA(&Cals[c], Codes[i] >> FIFO_SHIFT) - dIdeal);
+				}
+				if (dError > dWorst)
+				{
+					dWorst = dError;
+				}
+			}
+
+			printf("bits=%u offset=%d gain_error=%d volt=%u gain_scale=%.4f "
+				   "worst_error_lsb=%.3f\n", D2A_BITS, Cals[c].iOffset,
+				   Cals[c].iGainError, Volts[v], dScale, dWorst);
+			if (dWorst > dWorstAll)
+			{
+				dWorstAll = dWorst;
+			}
+		}
+	}
+
+	if (dWorstAll > MAX_ERROR_LSB)
+	{
+		iFailed = 1;
+	}
+	printf("worst_error_lsb=%.3f\n%s\n", dWorstAll, iFailed ? "FAIL" : "PASS");
+
+	return iFailed;
+}
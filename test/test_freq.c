@@ -0,0 +1,144 @@
+/******************************************************************************
+ * File Name:	test_freq.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Checks the frequency of the DDS output, measured from the
+ *				D/A codes, against the frequency asked for, and compares it
+ *				with the old engine (OCR1A = F_CPU / (Freq * 100), 100
+ *				samples a period, 40 to 100 Hz in 5 Hz steps). Also reports
+ *				the host time per sample, to compare builds.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdio.h>
+#include <math.h>
+
+#include "sine.h"
+#include "host.h"
+
+/* Largest error allowed, in parts per million. Rounding the tuning word is
+ * up to 1.2 ppm at 0.1 Hz, and the measurement adds a little. */
+#define MAX_PPM				2.0
+
+/* Samples measured. The crossings are only placed to a small part of a
+ * sample, so the run is made long enough for that to be well under
+ * MAX_PPM. It's 200 periods at the lowest frequency. */
+#define MEASURE_SAMPLES		1000000UL
+
+static uint16_t Codes[MEASURE_SAMPLES];
+
+/* Frequency of the captured codes, from their rising crossings of the
+ * middle of their range. Each crossing is placed between samples by linear
+ * interpolation, and the period is the least-squares slope of crossing time
+ * against crossing number, so the error in placing any one of them mostly
+ * averages out. */
+static double MeasureFreq(double dRate)
+{
+	double dMid, dAt;
+	double dSumK = 0, dSumT = 0, dSumKK = 0, dSumKT = 0, dN;
+	unsigned long i, ulCrossings = 0;
+	uint16_t uiMin = 0xFFFF, uiMax = 0;
+
+	for (i = 0; i < HostCodes; i++)
+	{
+		uiMin = (Codes[i] < uiMin) ? Codes[i] : uiMin;
+		uiMax = (Codes[i] > uiMax) ? Codes[i] : uiMax;
+	}
+	dMid = (uiMin + uiMax) / 2.0;
+
+	for (i = 1; i < HostCodes; i++)
+	{
+		if ((Codes[i - 1] < dMid) && (Codes[i] >= dMid))
+		{
+			dAt = (i - 1) + (dMid - Codes[i - 1]) / (Codes[i] - Codes[i - 1]);
+			dSumK += ulCrossings;
+			dSumT += dAt;
+			dSumKK += (double)ulCrossings * ulCrossings;
+			dSumKT += ulCrossings * dAt;
+			++ulCrossings;
+		}
+	}
+
+	dN = ulCrossings;
+	return (ulCrossings < 2) ? 0 :
+		dRate * (dN * dSumKK - dSumK * dSumK) / (dN * dSumKT - dSumK * dSumT);
+}
+
+/* Measured error of the DDS output at Freq tenths of a Hz, in ppm */
+static double DdsPpm(uint16_t Freq)
+{
+	double dFreq = Freq / 10.0;
+
+	if (SetFreq(Freq) != NO_ERROR)
+	{
+		printf("SetFreq(%u) failed\n", Freq);
+		return 1e6;
+	}
+
+	// Let the change commit, at the end of a period
+	HostRun((unsigned long)(2 * HostSampleRate() / dFreq) + 64);
+
+	HostCapture(Codes, MEASURE_SAMPLES);
+	HostRun(MEASURE_SAMPLES);
+
+	return (MeasureFreq(HostSampleRate()) / dFreq - 1) * 1e6;
+}
+
+/* Error of the old engine at Freq Hz, in ppm. CTC mode counts OCR1A + 1. */
+static double OldPpm(unsigned int Freq)
+{
+	unsigned long ulOcr = F_CPU / (Freq * 100UL);
+
+	return ((double)F_CPU / ((ulOcr + 1) * 100.0) / Freq - 1) * 1e6;
+}
+
+int main(void)
+{
+	static const uint16_t Extra[] = {1, 5, 401, 1234, 5000, 10000, 25000, 29999};
+	double dPpm, dWorst = 0;
+	unsigned int Freq, i;
+	int iFailed = 0;
+
+	initSine();
+	SetVolt(500);
+
+	// Everything the old engine could do, old against new
+	for (Freq = 40; Freq <= 100; Freq += 5)
+	{
+		dPpm = DdsPpm(Freq * 10);
+		printf("freq=%u.0 old_ppm=%.1f dds_ppm=%.3f\n", Freq, OldPpm(Freq), dPpm);
+		if ((fabs(dPpm) > MAX_PPM) || (fabs(dPpm) >= fabs(OldPpm(Freq))))
+		{
+			iFailed = 1;
+		}
+		if (fabs(dPpm) > dWorst)
+		{
+			dWorst = fabs(dPpm);
+		}
+	}
+
+	// And what it couldn't: sub-Hz steps and the rest of the range
+	for (i = 0; i < sizeof(Extra) / sizeof(Extra[0]); i++)
+	{
+		dPpm = DdsPpm(Extra[i]);
+		printf("freq=%u.%u dds_ppm=%.3f\n", Extra[i] / 10, Extra[i] % 10, dPpm);
+		if (fabs(dPpm) > MAX_PPM)
+		{
+			iFailed = 1;
+		}
+		if (fabs(dPpm) > dWorst)
+		{
+			dWorst = fabs(dPpm);
+		}
+	}
+
+	SetFreq(1000);
+	HostCapture(NULL, 0);
+	printf("worst_dds_ppm=%.3f host_ns_per_sample=%.1f\n",
+		   dWorst, HostNsPerSample(1000000));
+	printf("%s\n", iFailed ? "FAIL" : "PASS");
+
+	return iFailed;
+}
@@ -0,0 +1,200 @@
+/******************************************************************************
+ * File Name:	test_gain.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Checks the divide-free gain from CalcSineValues against the
+ *				exact gain, and that the renderer only ever uses a whole
+ *				gain, the old one or the new one, even when the gain is
+ *				changed partway through a block. The new gain must take over
+ *				at the bottom of the period, and nowhere else. Built from
+ *				inside sine.c.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/* Every table read goes through here, so a change can be made at any point
+ * in a block, the way the menu's Timer 0 ISR can break into the renderer. */
+static uint16_t HostReadWord(const void *);
+#undef pgm_read_word
+#define pgm_read_word(p)	HostReadWord(p)
+
+#include "sine.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "host.h"
+
+/* Voltage changes made partway through a block */
+#define CHANGES				2000
+
+/* Gain error allowed, in gain counts: the rounding, plus the truncation of
+ * GAIN_RECIPROCAL at the top voltage. */
+#define MAX_GAIN_ERROR		0.52
+
+static unsigned long ulReads, ulChangeAt;
+static unsigned int uiChangeVolt;
+
+static uint16_t HostReadWord(const void *pWord)
+{
+	if (++ulReads == ulChangeAt)
+	{
+		CalcSineValues(uiChangeVolt);
+	}
+	return *(const uint16_t *)pWord;
+}
+
+/* Gain for a voltage, done the long way */
+static double ExactGain(unsigned int Volt)
+{
+	return (double)(D2A_FULL_SCALE << GAIN_FRAC_BITS) * Volt / VOLTAGE_FULL_SCALE;
+}
+
+/* What the gain was before, with the voltage cut to tenths of a volt */
+static unsigned int OldGain(unsigned int Volt)
+{
+	return (unsigned int)((D2A_FULL_SCALE << GAIN_FRAC_BITS) * (Volt / 10) /
+						  (VOLTAGE_FULL_SCALE / 10));
+}
+
+/* Renders a block from a given phase at a voltage that's already been
+ * committed */
+static void RenderAt(uint16_t *pBlock, unsigned long ulAt, unsigned int Volt)
+{
+	CalcSineValues(Volt);
+	CommitGain();
+	VoicePhase[0] = ulAt;
+	RenderSamples(pBlock, SAMPLE_BLOCK_SIZE);
+}
+
+int main(void)
+{
+	uint16_t Old[SAMPLE_BLOCK_SIZE], New[SAMPLE_BLOCK_SIZE];
+	uint16_t Block[SAMPLE_BLOCK_SIZE], Period[SAMPLE_FIFO_SIZE];
+	unsigned int Volt, OldVolt, uiPrevGain;
+	unsigned char ucPrevArray, ucCommit, ucChange, j;
+	uint32_t ulAt;
+	unsigned long ulReadsPerSample, ulLeft, ulPeriod;
+	unsigned long ulOld = 0, ulSwitched = 0, ulWrong = 0, ulLost = 0;
+	unsigned long ulUntidy = 0;
+	double dErr, dWorst = 0, dWorstOld = 0;
+	int i, iFailed = 0;
+
+	initSine();
+
+	// Every voltage the gain can be built for
+	for (Volt = 0; Volt <= MAX_VOLTAGE; Volt++)
+	{
+		CalcSineValues(Volt);
+		dErr = fabs(VoltageGain[ucActiveVoltArray] - ExactGain(Volt));
+		dWorst = (dErr > dWorst) ? dErr : dWorst;
+		dErr = fabs(OldGain(Volt) - ExactGain(Volt));
+		dWorstOld = (dErr > dWorstOld) ? dErr : dWorstOld;
+	}
+	printf("worst_gain_error=%.3f old_worst_gain_error=%.3f "
+		   "(gain counts, %u a D/A count)\n",
+		   dWorst, dWorstOld, 1u << GAIN_FRAC_BITS);
+	if (dWorst > MAX_GAIN_ERROR)
+	{
+		iFailed = 1;
+	}
+
+	/* Change the voltage at a random table read inside a block that is
+	 * near the bottom of the period. Up to the sample where the phase
+	 * passes the commit point, the block must be the same as one rendered
+	 * at the old voltage. From there on it must be the new voltage's, if the
+	 * change was made by then, or the old one's if not. A change that's
+	 * missed must be picked up within another period. The entry that was
+	 * active when the change started may be in use, so it must come through
+	 * untouched. */
+	srand(4);
+	SetFreq(570);
+	ulPeriod = (unsigned long)(HostSampleRate() / 57) + 1;
+	HostRun(2 * ulPeriod);
+	for (i = 0; i < CHANGES; i++)
+	{
+		ulAt = AMPLITUDE_COMMIT_PHASE -
+			   (rand() % (SAMPLE_BLOCK_SIZE + 2)) * ulMainStep - rand() % ulMainStep;
+		OldVolt = MIN_VOLTAGE + rand() % (MAX_VOLTAGE - MIN_VOLTAGE + 1);
+		uiChangeVolt = MIN_VOLTAGE + rand() % (MAX_VOLTAGE - MIN_VOLTAGE + 1);
+
+		RenderAt(New, ulAt, uiChangeVolt);
+		ulReads = 0;
+		RenderAt(Old, ulAt, OldVolt);
+		ulReadsPerSample = ulReads / SAMPLE_BLOCK_SIZE;
+		ucPrevArray = ucActiveVoltArray;
+		uiPrevGain = VoltageGain[ucPrevArray];
+
+		// The sample where the phase passes the commit point, if any
+		for (ucCommit = 0; ucCommit < SAMPLE_BLOCK_SIZE; ucCommit++)
+		{
+			if ((uint32_t)(ulAt + (ucCommit + 1) * ulMainStep -
+						   AMPLITUDE_COMMIT_PHASE) < ulMainStep)
+			{
+				break;
+			}
+		}
+
+		ulReads = 0;
+		ulChangeAt = 1 + rand() % (ulReadsPerSample * SAMPLE_BLOCK_SIZE);
+		ucChange = (ulChangeAt - 1) / ulReadsPerSample;
+		VoicePhase[0] = ulAt;
+		RenderSamples(Block, SAMPLE_BLOCK_SIZE);
+		ulChangeAt = 0;
+		if ((VoltageGain[ucPrevArray] != uiPrevGain) ||
+			(ucActiveVoltArray == ucPrevArray))
+		{
+			++ulUntidy;
+		}
+
+		for (j = 0; j < SAMPLE_BLOCK_SIZE; j++)
+		{
+			if (Block[j] != (((j >= ucCommit) && (ucChange <= ucCommit)) ?
+							 New[j] : Old[j]))
+			{
+				break;
+			}
+		}
+		if (j != SAMPLE_BLOCK_SIZE)
+		{
+			++ulWrong;
+		}
+		else if ((ucCommit < SAMPLE_BLOCK_SIZE) && (ucChange <= ucCommit))
+		{
+			++ulSwitched;
+		}
+		else
+		{
+			++ulOld;
+		}
+
+		// Within another period, the new gain must be in use
+		for (ulLeft = ulPeriod; ulLeft >= SAMPLE_FIFO_SIZE;
+			 ulLeft -= SAMPLE_FIFO_SIZE)
+		{
+			RenderSamples(Period, SAMPLE_FIFO_SIZE);
+		}
+		RenderSamples(Period, ulLeft);
+		if ((lRampGain >> GAIN_RAMP_BITS) != VoltageGain[ucActiveVoltArray])
+		{
+			++ulLost;
+		}
+	}
+	printf("changes=%u blocks_old=%lu blocks_switched=%lu blocks_mixed=%lu "
+		   "changes_lost=%lu active_entry_disturbed=%lu\n",
+		   CHANGES, ulOld, ulSwitched, ulWrong, ulLost, ulUntidy);
+	if ((ulWrong != 0) || (ulLost != 0) || (ulUntidy != 0))
+	{
+		iFailed = 1;
+	}
+
+	printf("%s\n", iFailed ? "FAIL" : "PASS");
+
+	return iFailed;
+}
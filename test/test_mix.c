@@ -0,0 +1,94 @@
+/******************************************************************************
+ * File Name:	test_mix.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Checks that the mixer saturates, rather than wrapping, with
+ *				every voice at full level, and times the renderer for each
+ *				number of voices.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dtoa.h"
+#include "sine.h"
+#include "host.h"
+
+#define SAMPLES				20000UL
+
+static uint16_t Codes[SAMPLES];
+
+int main(void)
+{
+	unsigned long i;
+	unsigned int uiMin = 0xFFFF, uiMax = 0, uiJump = 0, uiStep;
+	unsigned char ucVoice;
+	int iFailed = 0;
+
+	initSine();
+	SetVolt(500);
+	SetFreq(1000);
+
+	// Every voice at full level, at the main signal's frequency
+	for (ucVoice = 1; ucVoice < MIXER_VOICES; ucVoice++)
+	{
+		SetVoice(ucVoice, 100, 100, 0);
+	}
+	HostRun(SAMPLES);
+
+	HostCapture(Codes, SAMPLES);
+	HostRun(SAMPLES);
+	for (i = 0; i < HostCodes; i++)
+	{
+		if (Codes[i] < uiMin)
+		{
+			uiMin = Codes[i];
+		}
+		if (Codes[i] > uiMax)
+		{
+			uiMax = Codes[i];
+		}
+		if (i != 0)
+		{
+			uiStep = abs((int)Codes[i] - (int)Codes[i - 1]);
+			if (uiStep > uiJump)
+			{
+				uiJump = uiStep;
+			}
+		}
+	}
+
+	/* Clipped, it sits on both rails. Wrapped, it jumps most of the way
+	 * across the range in one sample. */
+	printf("voices=%u min_code=%u max_code=%u largest_step=%u\n",
+		   MIXER_VOICES, uiMin, uiMax, uiJump);
+	if ((uiMin != 0) || (uiMax != D2A_FULL_SCALE) ||
+		(uiJump > D2A_FULL_SCALE / 4))
+	{
+		iFailed = 1;
+	}
+
+	// Cost of each voice
+	HostCapture(NULL, 0);
+	for (ucVoice = MIXER_VOICES - 1; ucVoice >= 1; ucVoice--)
+	{
+		SetVoice(ucVoice, 0, 0, 0);
+	}
+	for (ucVoice = 1; ucVoice <= MIXER_VOICES; ucVoice++)
+	{
+		if (ucVoice > 1)
+		{
+			SetVoice(ucVoice - 1, 50 * ucVoice, 10, 0);
+		}
+		HostRun(SAMPLES);
+		printf("voices=%u host_ns_per_sample=%.1f\n", ucVoice,
+			   HostNsPerSample(1000000));
+	}
+
+	printf("%s\n", iFailed ? "FAIL" : "PASS");
+
+	return iFailed;
+}
@@ -0,0 +1,142 @@
+/******************************************************************************
+ * File Name:	test_ppm.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Works out the frequency actually made for every frequency
+ *				SetFreq accepts, and reports its error in ppm. Each time the
+ *				planner sets Timer 1, the Timer 1 ISR from interrpt.c is run
+ *				for a full cycle of its error accumulator to get the exact
+ *				average sample rate. Also checks that FreqActual reports the
+ *				frequency to a hundredth of a Hz. sine.c is included, so the
+ *				tuning word can be read.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdio.h>
+#include <math.h>
+
+#include "sine.c"
+#include "host.h"
+
+/* Largest error allowed. Rounding the tuning word is up to 1.2 ppm at
+ * 0.1 Hz, and less as the frequency goes up. */
+#define MAX_PPM				1.2
+
+/* Largest error allowed in the sample rate. The divider is exact to
+ * 1/65536 of a count, and there are 800 or more counts a period. */
+#define MAX_RATE_PPM		0.05
+
+/* FreqActual is rounded to a hundredth of a Hz */
+#define MAX_REPORT_ERROR	0.0051
+
+/* The Timer 1 ISR's error accumulator repeats after this many periods */
+#define ACCUMULATOR_CYCLE	65536UL
+
+void TIMER1_COMPA_vect(void);
+
+/* What interrpt.c calls besides the signal */
+void heartbeat(void)
+{
+}
+
+void RunMenu(void)
+{
+}
+
+void ReportError(eErrorType Error)
+{
+	(void)Error;
+}
+
+/* Average sample rate Timer 1 makes, from its counts over a full cycle of
+ * the ISR's error accumulator. CTC mode counts OCR1A + 1 clocks per period.
+ */
+static double MeasureSampleRate(void)
+{
+	static const unsigned int Prescalers[] = {1, 8, 64, 256, 1024};
+	unsigned long long ullCounts = 0;
+	unsigned long i;
+
+	for (i = 0; i < ACCUMULATOR_CYCLE; i++)
+	{
+		TIMER1_COMPA_vect();
+		ullCounts += OCR1A + 1UL;
+	}
+
+	return (double)F_CPU * ACCUMULATOR_CYCLE /
+		   ((double)ullCounts * Prescalers[(TCCR1B & 7) - 1]);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *pTable = (argc > 1) ? fopen(argv[1], "w") : NULL;
+	double dRate, dMade, dPpm, dWorstPpm = 0;
+	double dReport, dWorstReport = 0, dWorstRate = 0;
+	uint16_t Freq, WorstFreq = 0;
+	int iFailed = 0;
+
+	initSine();
+	dRate = MeasureSampleRate();
+
+	for (Freq = MIN_FREQUENCY; Freq <= MAX_FREQUENCY; Freq++)
+	{
+		// SetTimer1Period loads OCR1A, so a new plan shows up there
+		OCR1A = 0;
+		if (SetFreq(Freq) != NO_ERROR)
+		{
+			printf("SetFreq(%u) failed\n", Freq);
+			iFailed = 1;
+			continue;
+		}
+		if (OCR1A != 0)
+		{
+			dRate = MeasureSampleRate();
+			dPpm = fabs(dRate / Plan.ulSampleRate - 1) * 1e6;
+			dWorstRate = (dPpm > dWorstRate) ? dPpm : dWorstRate;
+		}
+
+		dMade = (uint32_t)Voices[0].ulStep * dRate / 4294967296.0;
+		dPpm = (dMade / (Freq / 10.0) - 1) * 1e6;
+		dReport = fabs(GET_FREQ_ACTUAL() / 100.0 - dMade);
+		if (pTable != NULL)
+		{
+			fprintf(pTable, "freq=%u.%u rate=%.4f made=%.6f ppm=%.4f "
+					"reported=%lu.%02lu\n", Freq / 10, Freq % 10, dRate,
+					dMade, dPpm,
+					(unsigned long)GET_FREQ_ACTUAL() / 100,
+					(unsigned long)GET_FREQ_ACTUAL() % 100);
+		}
+
+		if (fabs(dPpm) > dWorstPpm)
+		{
+			dWorstPpm = fabs(dPpm);
+			WorstFreq = Freq;
+		}
+		if (dReport > dWorstReport)
+		{
+			dWorstReport = dReport;
+		}
+	}
+
+	if ((dWorstPpm > MAX_PPM) || (dWorstRate > MAX_RATE_PPM) ||
+		(dWorstReport > MAX_REPORT_ERROR))
+	{
+		iFailed = 1;
+	}
+
+	printf("f_cpu=%lu worst_sample_rate_ppm=%.4f\n", (unsigned long)F_CPU,
+		   dWorstRate);
+	printf("frequencies=%u worst_ppm=%.4f at=%u.%u worst_report_error_hz=%.5f\n",
+		   (unsigned int)(MAX_FREQUENCY - MIN_FREQUENCY + 1), dWorstPpm,
+		   WorstFreq / 10, WorstFreq % 10, dWorstReport);
+	printf("%s\n", iFailed ? "FAIL" : "PASS");
+
+	if (pTable != NULL)
+	{
+		fclose(pTable);
+	}
+
+	return iFailed;
+}
@@ -0,0 +1,259 @@
+/******************************************************************************
+ * File Name:	test_spectrum.c
+ * Program:		Host tests for the signal generator
+ * Author:		agent
+ * Purpose:		Spectral purity benchmark. Captures the D/A codes for a set
+ *				of frequencies and voltages, and reports the THD, SFDR and
+ *				noise of each from an FFT, along with the host time per
+ *				sample. The Makefile builds it once for each variant (table
+ *				size, interpolation, D/A bits), and VARIANT names it.
+ *
+ *				Each result is one line of key=value pairs:
+ *				  variant=<name> freq=<Hz> volt=<V> rate=<Hz> thd_dbc=<dB>
+ *				  sfdr_dbc=<dB> noise_dbc=<dB> band_noise_dbc=<dB>
+ *				  host_ns_per_sample=<ns>
+ *				All levels are relative to the fundamental. noise_dbc is
+ *				everything but DC, the fundamental and harmonics 2 to 10,
+ *				and band_noise_dbc the part of it below an eighth of the
+ *				sample rate, where noise shaped dither leaves little.
+ *				A line before them gives budget_cycles, the AVR clocks a
+ *				sample the planner budgets for (SAMPLE_CYCLES). It is not
+ *				measured here; the real figure on the target comes from
+ *				the cap command of a SIGNAL_CAPTURE build.
+ *
+ *  Date	Changed by:	Changes:
+ * -------	-----------	-------------------------------------------------------
+ * 16Oct26	agent		Original file.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "dtoa.h"
+#include "sine.h"
+#include "host.h"
+
+#if !defined (VARIANT)
+#define VARIANT				"default"
+#endif
+
+#define FFT_BITS			16
+#define FFT_SIZE			(1UL << FFT_BITS)
+
+/* Bins either side of a tone that hold its power, for the window below */
+#define TONE_BINS			4
+#define HARMONICS			10
+#define BAND_BINS			(FFT_SIZE / 8)
+
+/* Floor the SFDR must reach at full scale: 6 dB a bit of the D/A or of the
+ * table index, whichever has fewer, less a margin */
+#define MIN_SFDR_DBC		(6.0 * fmin(D2A_BITS, log2(SAMPLES_PER_PERIOD)) - 12)
+
+static const struct
+{
+	unsigned int uiFreq;		/* Tenths of a Hz */
+	unsigned int uiVolt;		/* Hundredths of a volt */
+} Points[] =
+{	// Away from whole fractions of the sample rate, so the error spreads
+
+	{    10, 500 }, {    10, 100 },
+	{   513, 500 }, {   513, 100 },
+	{  5123, 500 }, {  5123, 100 },
+	{ 20117, 500 }, { 20117, 100 },
+};
+
+static uint16_t Codes[FFT_SIZE];
+static double Re[FFT_SIZE], Im[FFT_SIZE];
+
+/******************************************************************************
+ * In-place radix-2 FFT
+ ******************************************************************************/
+static void Fft(double *pRe, double *pIm)
+{
+	unsigned long i, j, ulHalf, ulStep, k;
+	double dAngle, dWr, dWi, dTr, dTi;
+
+	// Bit-reverse the order
+	for (i = 0, j = 0; i < FFT_SIZE; i++)
+	{
+		if (i < j)
+		{
+			dTr = pRe[i]; pRe[i] = pRe[j]; pRe[j] = dTr;
+			dTi = pIm[i]; pIm[i] = pIm[j]; pIm[j] = dTi;
+		}
+		for (k = FFT_SIZE >> 1; (k != 0) && (j & k); k >>= 1)
+		{
+			j ^= k;
+		}
+		j |= k;
+	}
+
+	for (ulStep = 2; ulStep <= FFT_SIZE; ulStep <<= 1)
+	{
+		ulHalf = ulStep >> 1;
+		for (k = 0; k < ulHalf; k++)
+		{
+			dAngle = -2 * M_PI * k / ulStep;
+			dWr = cos(dAngle);
+			dWi = sin(dAngle);
+			for (i = k; i < FFT_SIZE; i += ulStep)
+			{
+				j = i + ulHalf;
+				dTr = dWr * pRe[j] - dWi * pIm[j];
+				dTi = dWr * pIm[j] + dWi * pRe[j];
+				pRe[j] = pRe[i] - dTr;
+				pIm[j] = pIm[i] - dTi;
+				pRe[i] += dTr;
+				pIm[i] += dTi;
+			}
+		}
+	}
+}
+
+/******************************************************************************
+ * Bin of a tone, folded into the first Nyquist zone
+ ******************************************************************************/
+static long FoldBin(double dBin)
+{
+	dBin = fmod(dBin, FFT_SIZE);
+	if (dBin > FFT_SIZE / 2)
+	{
+		dBin = FFT_SIZE - dBin;
+	}
+
+	return lround(dBin);
+}
+
+/******************************************************************************
+ * Power in the bins around a tone, each bin counted once
+ ******************************************************************************/
+static double TonePower(const double *pPower, long lCentre,
+						unsigned char *pUsed)
+{
+	long lBin;
+	double dSum = 0;
+
+	for (lBin = lCentre - TONE_BINS; lBin <= lCentre + TONE_BINS; lBin++)
+	{
+		if ((lBin >= 0) && (lBin <= (long)(FFT_SIZE / 2)) && !pUsed[lBin])
+		{
+			dSum += pPower[lBin];
+			pUsed[lBin] = 1;
+		}
+	}
+
+	return dSum;
+}
+
+/******************************************************************************
+ * Measures one frequency and voltage. Returns the SFDR.
+ ******************************************************************************/
+static double Measure(unsigned int uiFreq, unsigned int uiVolt)
+{
+	static double Power[FFT_SIZE / 2 + 1];
+	static unsigned char Used[FFT_SIZE / 2 + 1];
+	double dRate, dMean = 0, dPhase, dBin, dFund, dHarm = 0, dNoise = 0;
+	double dPeak = 0, dSpur = 0, dBand = 0, dNs;
+	unsigned long i;
+	long lFund;
+	unsigned char h;
+
+	SetVolt(uiVolt);
+	SetFreq(uiFreq);
+	HostRun(FFT_SIZE / 8);				// Let the amplitude ramp settle
+
+	HostCapture(Codes, FFT_SIZE);
+	dNs = HostNsPerSample(FFT_SIZE);
+	HostCapture(NULL, 0);
+	dRate = HostSampleRate();
+
+	// Blackman-Harris window, which leaves the sidelobes below -92 dB
+	for (i = 0; i < FFT_SIZE; i++)
+	{
+		dMean += Codes[i];
+	}
+	dMean /= FFT_SIZE;
+	for (i = 0; i < FFT_SIZE; i++)
+	{
+		dPhase = 2 * M_PI * i / FFT_SIZE;
+		Re[i] = (Codes[i] - dMean) * (0.35875 - 0.48829 * cos(dPhase) +
+									  0.14128 * cos(2 * dPhase) -
+									  0.01168 * cos(3 * dPhase));
+		Im[i] = 0;
+	}
+	Fft(Re, Im);
+
+	for (i = 0; i <= FFT_SIZE / 2; i++)
+	{
+		Power[i] = Re[i] * Re[i] + Im[i] * Im[i];
+		Used[i] = 0;
+	}
+
+	// DC is left out. Then the fundamental and its harmonics.
+	dBin = (uiFreq / 10.0) * FFT_SIZE / dRate;
+	lFund = FoldBin(dBin);
+	TonePower(Power, 0, Used);
+	dFund = TonePower(Power, lFund, Used);
+	for (h = 2; h <= HARMONICS; h++)
+	{
+		dHarm += TonePower(Power, FoldBin(dBin * h), Used);
+	}
+
+	for (i = 0; i <= FFT_SIZE / 2; i++)
+	{
+		if (!Used[i])
+		{	// Everything left is noise
+			dNoise += Power[i];
+			if (i < BAND_BINS)
+			{
+				dBand += Power[i];
+			}
+		}
+
+		if (labs((long)i - lFund) <= TONE_BINS)
+		{
+			if (Power[i] > dPeak)
+			{
+				dPeak = Power[i];
+			}
+		}
+		else if ((i > TONE_BINS) && (Power[i] > dSpur))
+		{	// Harmonics count as spurs
+			dSpur = Power[i];
+		}
+	}
+
+	printf("variant=%s freq=%.1f volt=%.2f rate=%.1f thd_dbc=%.1f "
+		   "sfdr_dbc=%.1f noise_dbc=%.1f band_noise_dbc=%.1f "
+		   "host_ns_per_sample=%.1f\n",
+		   VARIANT, uiFreq / 10.0, uiVolt / 100.0, dRate,
+		   10 * log10(dHarm / dFund), 10 * log10(dPeak / dSpur),
+		   10 * log10(dNoise / dFund), 10 * log10(dBand / dFund), dNs);
+
+	return 10 * log10(dPeak / dSpur);
+}
+
+int main(void)
+{
+	unsigned char i;
+	double dSfdr;
+	int iFailed = 0;
+
+	initSine();
+
+	// A budget, not a measurement, so it's kept out of the results
+	printf("variant=%s budget_cycles=%u\n", VARIANT,
+		   (unsigned int)SAMPLE_CYCLES);
+
+	for (i = 0; i < sizeof(Points) / sizeof(Points[0]); i++)
+	{
+		dSfdr = Measure(Points[i].uiFreq, Points[i].uiVolt);
+		if ((Points[i].uiVolt == 500) && (dSfdr < MIN_SFDR_DBC))
+		{
+			iFailed = 1;
+		}
+	}
+
+	printf("%s\n", iFailed ? "FAIL" : "PASS");
+	return iFailed;
+}